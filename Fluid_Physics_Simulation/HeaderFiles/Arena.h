@@ -0,0 +1,47 @@
+#pragma once
+#include<vector>
+#include<cstddef>
+
+// A view of n elements in an arena, indexed like the vector it replaces
+template <typename T>
+struct Span
+{
+	T* data;
+	int count;
+
+	int size() const { return count; }
+	T& operator[](int k) const { return data[k]; }
+};
+
+// Bump allocators for the temporary buffers of a step, one per OpenMP thread. Every step starts
+// by resetting all of them, and a buffer lives until then. Taking a buffer is moving a pointer,
+// so the passes never go to the heap or contend for its lock. A step that needs more than an
+// arena holds spills into blocks from the heap, and the next reset grows the arena to what the
+// step used, so after the first few steps a step allocates nothing.
+// With COUNT_ALLOCATIONS defined, as in the Debug configurations, Arena.cpp also replaces the global
+// operator new and delete to count every heap allocation for -alloccheck.
+class Arena
+{
+public:
+	Arena() : base(nullptr), capacity(0), top(0), spilled(0) {}
+
+	static Arena& local();          // the calling thread's
+	static void resetAll();
+	static long long allocations(); // heap allocations since startup, by any thread, 0 without COUNT_ALLOCATIONS
+	static const bool counting;     // COUNT_ALLOCATIONS was defined
+
+	template <typename T> T* alloc(int n) { return (T*)allocBytes(n * sizeof(T)); }
+	// gives back the tail of the last buffer taken, when fewer elements were used than asked for
+	template <typename T> void trim(T* last, int used) { trimBytes(last, used * sizeof(T)); }
+
+private:
+	char* base;
+	size_t capacity;
+	size_t top;
+	size_t spilled;                 // bytes taken from the heap since the last reset
+	std::vector <char*> spills;
+
+	void* allocBytes(size_t bytes);
+	void trimBytes(void* last, size_t bytes);
+	void reset();
+};
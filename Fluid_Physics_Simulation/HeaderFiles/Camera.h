@@ -0,0 +1,45 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include<GLM/glm.hpp>
+
+// 2D pan/zoom camera. World coordinates map to clip space as (world - center) * zoom,
+// so the default camera (center 0, zoom 1) shows the original [-1,1] view.
+// With orbit set (3D mode) it is a perspective camera circling the tank instead:
+// dragging and the arrow keys turn it, zooming moves it closer.
+class Camera
+{
+public:
+	static glm::vec2 center;
+	static float zoom;
+	static int width;
+	static int height;
+
+	// level of detail
+	static bool lod;
+	static float pointPixels;    // particles smaller than this radius (px) are drawn as points
+	static float lowPixels;      // below this radius (px) use a quarter of the segments
+	static float mediumPixels;   // below this radius (px) use half of the segments
+	static float splatPixels;    // cells smaller than this (px) may be aggregated into one splat
+	static int splatCount;       // minimum particles for a cell to be aggregated
+
+	// 3D orbit
+	static bool orbit;
+	static float yaw;
+	static float pitch;
+	static float fieldOfView;    // vertical, in radians
+
+	static void attach(GLFWwindow* window, int w, int h);
+	static void reset();
+	static void setUniform(int view_Location);
+	static float pixelsPerUnit();
+	static void visibleBounds(glm::vec2& lo, glm::vec2& hi);
+	static glm::vec2 screenToWorld(double x, double y);
+	static glm::mat4 projection();
+	static glm::mat4 view();
+
+	static void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
+	static void cursorCallback(GLFWwindow* window, double x, double y);
+	static void mouseCallback(GLFWwindow* window, int button, int action, int mods);
+	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include<GLM/glm.hpp>
+#include<vector>
+#include<string>
+
+// Static container walls for the 2D SPH solver, read from an OBJ file: "v x y" vertices and
+// "l" or "f" loops, each closing back to its first vertex. The fluid is inside an odd number
+// of loops, so an outer loop holds it and loops inside it are obstacles. The walls are baked
+// into a grid of s_Radius / 4 cells holding the signed distance to the nearest wall (positive
+// in the fluid) and its gradient, and what the solid within a smoothing length would add to a
+// particle's density, pressure and viscosity sums if it were fluid at rest. A particle's wall
+// interaction is then one bilinear lookup instead of a layer of boundary particles.
+class Container
+{
+public:
+	struct Sample
+	{
+		float distance;
+		glm::vec2 normal;           // away from the walls
+		float density;
+		float nearDensity;
+		glm::vec2 pressure;         // times the particle's pressure over targetDensity
+		glm::vec2 nearPressure;     // times its near density and nearPressureMultiplier
+		float viscosity;            // times its velocity relative to the walls
+	};
+
+	static bool enabled;
+	static std::vector <glm::vec2> vertices;
+	static std::vector <int> loopStarts;
+	static std::vector <int> loopCounts;
+	static glm::vec2 lower;         // the loops' bounds
+	static glm::vec2 upper;
+	static float cellSize;
+	static glm::ivec2 gridSize;     // nodes
+	static std::vector <Sample> grid;
+
+	static bool load(const std::string& filePath);
+	static void bake();
+	static bool inside(glm::vec2 pos);
+	static float distance(glm::vec2 pos);
+	static void sample(float x, float y, Sample& s);
+	static void keepInside(std::vector <float>& centers, float radius);
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include<GLM/glm.hpp>
+#include<vector>
+#include "../HeaderFiles/Particle.h"
+
+// Divergence-free SPH: pressure is not taken from an equation of state but solved for.
+// Before the drift a density solve corrects the velocities until the predicted density
+// is within densityThreshold of rest, after it a divergence solve removes the remaining
+// compression rate. Both are Jacobi iterations over the neighbor lists, the density solve
+// is warm started from the previous step's pressures. The step is only limited by the CFL condition.
+class Dfsph
+{
+public:
+	static float restDensity;
+	static float stepSize;              // upper bound of the CFL limited step
+	static float densityThreshold;      // mean relative density error
+	static float divergenceThreshold;   // mean relative density change per step
+	static int minIterations;
+	static int maxIterations;
+	static float xsph;                  // XSPH velocity smoothing, stands in for viscosity at large steps
+
+	static std::vector <float> factors;       // 1 / (|sum grad W|^2 + sum |grad W|^2)
+	static std::vector <float> densityKappa;  // accumulated pressure / density^2, times dt^2
+
+	// last step, and totals for the averages printed on exit
+	static int densityIterations;
+	static int divergenceIterations;
+	static float densityError;
+	static float divergenceError;
+	static long long totalDensityIterations;
+	static long long totalDivergenceIterations;
+
+	static void computeDensities();
+	static void solveDensity(float dt);
+	static void solveDivergence(float dt);
+	static void step();
+};
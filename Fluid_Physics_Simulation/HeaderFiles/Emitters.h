@@ -0,0 +1,48 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include<GLM/glm.hpp>
+#include<vector>
+#include<string>
+
+// Inflow and outflow for the 2D SPH solver, read from a flow file. Each line is a kind and
+// a rectangle, "x0 y0 x1 y1":
+//   nozzle x0 y0 x1 y1 vx vy   a segment of particle sites, refilled as the jet moves off it
+//   source x0 y0 x1 y1 vx vy   an area of particle sites, refilled as the fluid drains from it
+//   drain  x0 y0 x1 y1         every particle entering the rectangle is removed
+// Particles that drift past the box's walls are removed too. The solver's particles are a
+// pool of a fixed capacity, reserved up front: a removed particle leaves a dead slot, held
+// asleep so that every pass skips it, on a free list that emission takes from before it
+// appends. When a quarter of the slots are dead the live particles are compacted to the
+// front, so a flow that runs indefinitely settles into reusing slots without allocating.
+class Emitters
+{
+public:
+	enum Kind { NOZZLE, SOURCE, DRAIN };
+	struct Emitter
+	{
+		int kind;
+		glm::vec2 lower;
+		glm::vec2 upper;
+		glm::vec2 velocity;         // given to the emitted particles
+	};
+
+	static bool enabled;
+	static int capacity;                        // solver particle slots, live or dead
+	static std::vector <Emitter> emitters;
+	static std::vector <int> freeSlots;         // dead slots of the solver's particles
+	static int numLive;
+	static int numSlots;                        // slots in use, live or dead
+	static long long numEmitted;
+	static long long numRemoved;
+	static long long numBlocked;                // particles not emitted because the pool was full
+	static int numCompactions;
+	static unsigned int vao;
+	static unsigned int vbo;
+
+	static bool load(const std::string& filePath);
+	template <int D, typename T>
+	static void update();
+	static int liveCount();
+	static void drawElements(int object_Location, int color_Location);
+};
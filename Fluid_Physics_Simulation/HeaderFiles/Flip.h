@@ -0,0 +1,46 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include<GLM/glm.hpp>
+#include<vector>
+#include "../HeaderFiles/Particle.h"
+
+// Hybrid particle-grid solver. Particles carry the velocity and are splatted onto a MAC
+// grid covering the box (x velocities on vertical cell faces, y velocities on horizontal
+// ones). The grid is made divergence free by a pressure solve, conjugate gradient
+// preconditioned with a multigrid V-cycle, and the velocity goes back to the particles
+// either FLIP style (the grid's change blended with PIC) or APIC (PIC plus a per particle
+// affine velocity). There are no neighbor loops, every particle only touches 2x3 faces.
+class Flip
+{
+public:
+	enum CellType { AIR, FLUID };
+
+	static int resolution;        // cells across the box
+	static float stepSize;        // upper bound of the CFL limited step
+	static float cflNumber;       // in cells per step
+	static float flipRatio;       // 1 pure FLIP, 0 pure PIC
+	static float driftCorrection; // share of the particle density excess a cell pushes out per step
+	static float tolerance;       // residual relative to the divergence
+	static int maxIterations;
+
+	static std::vector <float> u;          // (resolution + 1) x resolution
+	static std::vector <float> v;          // resolution x (resolution + 1)
+	static std::vector <float> uPrev;      // before forces and projection, for the FLIP update
+	static std::vector <float> vPrev;
+	static std::vector <float> pressure;   // resolution x resolution, warm starts the next solve
+	static std::vector <char> cellType;
+	static std::vector <glm::vec2> affineX;   // APIC: gradient of the particle's x velocity
+	static std::vector <glm::vec2> affineY;
+
+	// last step, and totals for the averages printed on exit
+	static int iterations;
+	static float residual;
+	static long long totalIterations;
+
+	static void transferToGrid();
+	static void project(float dt);
+	static void extrapolate();
+	static void transferToParticles();
+	static void step();
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include<GLM/glm.hpp>
+#include<vector>
+#include "../HeaderFiles/Particle.h"
+
+// The SPH step as OpenGL 4.3 compute passes over shader storage buffers.
+// The particle buffer is also bound as the instance buffer, so drawing needs no CPU copy.
+class GpuSolver
+{
+public:
+	// std430 layout of a particle in Sph.compute
+	struct GpuParticle
+	{
+		glm::vec4 pos;
+		glm::vec4 color;
+		glm::vec4 vel;
+		glm::vec4 predicted;
+		glm::vec4 accel;
+		glm::vec4 density;
+	};
+
+	enum Pass { INTEGRATE, CLEAR, COUNT, SCAN, SCATTER, DENSITY, FORCE, UPDATE, PASSES };
+
+	static const char* source;
+	static bool enabled;
+	static unsigned int programs[PASSES];
+	static unsigned int particleBuffer;
+	static unsigned int cellCountBuffer;
+	static unsigned int cellStartBuffer;
+	static unsigned int sortedBuffer;
+	static unsigned int slotBuffer;
+
+	static bool init();
+	static void upload();
+	static void download(std::vector<GpuParticle>& out);
+	static void step();
+	static void drawElements(int object_Location, int color_Location);
+	static bool validate(int steps);
+};
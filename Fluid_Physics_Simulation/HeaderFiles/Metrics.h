@@ -0,0 +1,36 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <string>
+
+// Per-frame CPU and GPU timings. GPU timer queries are read back LATENCY frames
+// later and only once the driver reports them available, so they never stall.
+class Metrics
+{
+public:
+	enum CpuTimer { CPU_PHYSICS, CPU_SURFACE, CPU_UPLOAD, CPU_DRAW, CPU_SWAP, CPU_TIMERS };
+	enum GpuTimer { GPU_BOUNDARY, GPU_PARTICLES, GPU_SURFACE, GPU_TIMERS };
+	static const int LATENCY = 4;
+
+	static bool gpuTimers;
+	static double cpuMs[CPU_TIMERS];      // current frame
+	static double gpuMs[GPU_TIMERS];      // last resolved frame
+	static double gpuFrameMs;             // last resolved frame, first to last timestamp
+	static int gpuFrame;                  // frame number the GPU values belong to
+	static double timeToFirstFrameMs;     // from process start to the first swap
+	static double activeFraction;         // particles the physics stepped in the last step, negative without +sleep or +local
+
+	static void init();
+	static bool open(const std::string& filePath);
+	static void beginFrame(int frame);
+	static void endFrame();
+	static void beginCpu(int timer);
+	static void endCpu(int timer);
+	static void beginGpu(int timer);
+	static void endGpu(int timer);
+	static void startupPhase(const char* name);
+	static void finish();
+	static void print();
+	static void summary();
+	static bool validate(int frames);     // -metricscheck, after finish
+};
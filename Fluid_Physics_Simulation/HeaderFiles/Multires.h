@@ -0,0 +1,32 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include<GLM/glm.hpp>
+#include<vector>
+#include "../HeaderFiles/Particle.h"
+
+// Adaptive particle resolution for the SPH solver. A particle of level l has mass 2^l and
+// smoothing length s_Radius * 2^(l / D), so it stands in for two particles of level l - 1.
+// After every step calm interior particles (low surface indicator and vorticity) merge in pairs
+// with their nearest candidate of the same level, and particles near the free surface or in
+// vortices split back into two. Both conserve mass and momentum. The surface indicator is the
+// length of the color field gradient times h, which does not depend on how far the weakly
+// compressible fluid is compressed. Pairs interact with the mean of their smoothing lengths.
+class Multires
+{
+public:
+	static bool enabled;
+	static int minLevel;            // finest level, below 0 splits finer than the spawned particles
+	static int maxLevel;            // coarsest level, at most 6 above minLevel
+	static float splitSurface;      // surface indicator above which a particle splits, about 1 at the free surface
+	static float mergeSurface;      // and below which it may merge, close to 0 in the bulk
+	static float splitVorticity;    // 1/s
+	static float mergeVorticity;
+	static int minAge;              // steps a particle keeps its level before it may change again
+
+	static int numSplits;
+	static int numMerges;
+
+	template <int D, typename T>
+	static void refine();
+};
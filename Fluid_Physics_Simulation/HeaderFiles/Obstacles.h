@@ -0,0 +1,52 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include<GLM/glm.hpp>
+#include<vector>
+
+// Moving rigid obstacles for the 2D SPH solver: circles, boxes and capsules, each going round
+// a scripted ellipse about its anchor and spinning. Before every step they are moved to the
+// end of the step and binned into the solver's cells by their bounds. checkBoundary then only
+// tests a particle against the obstacles binned in its cell, so the cost follows the cells the
+// obstacles cover instead of particles times obstacles.
+class Obstacles
+{
+public:
+	enum Shape { CIRCLE, BOX, CAPSULE, SHAPES };
+	struct Obstacle
+	{
+		int shape;
+		glm::vec2 size;             // circle: radius, box: half extents, capsule: half length and radius
+		glm::vec2 anchor;           // at anchor + amplitude * (cos, sin)(2 pi frequency t + phase)
+		glm::vec2 amplitude;
+		float frequency;            // Hz
+		float phase;
+		float spin;                 // radians per s
+		glm::vec2 pos;              // at the end of the step being taken
+		glm::vec2 velocity;
+		float angle;
+		glm::vec2 lower;            // bounds
+		glm::vec2 upper;
+	};
+
+	static bool enabled;
+	static int count;
+	static std::vector <Obstacle> obstacles;
+	// obstacles binned in each cell of the solver's grid over the rectangle of cells they span
+	static glm::ivec2 binLower;
+	static glm::ivec2 binSize;
+	static std::vector <int> cellStart;
+	static std::vector <int> cellObstacles;
+	static long long numPairs;                  // particles times obstacles over the binned cells
+	static unsigned int vao;
+	static unsigned int vbo;
+
+	static void generate();
+	static void update(double time);
+	template <int D, typename T>
+	static void bin();
+	static int binOf(glm::ivec2 cell);          // -1 outside the rectangle
+	static bool covers(glm::ivec2 cell);
+	static bool collide(glm::ivec2 cell, glm::vec2& pos, glm::vec2& velocity, float radius);
+	static void drawElements(int object_Location, int color_Location);
+};
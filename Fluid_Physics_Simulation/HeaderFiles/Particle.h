@@ -10,16 +10,27 @@
 #include<unordered_map>
 #include<iostream>
 #include "../HeaderFiles/Window.h"
+#include "../HeaderFiles/Camera.h"
+#include "../HeaderFiles/Metrics.h"
+#include "../HeaderFiles/SparseGrid.h"
+#include "../HeaderFiles/Arena.h"
 
 class Particle
 {
 public:
+	enum Solver { SOLVER_SPH, SOLVER_PBF, SOLVER_DFSPH, SOLVER_FLIP, SOLVER_APIC, SOLVERS };
+	static const char* solverNames[SOLVERS];
+	static int solver;
+
 	static std::vector <float> positions;
 	static std::vector <unsigned int> indices;
 	static std::vector <float> centers;
+	static std::vector <float> instances;
 	static std::vector <Particle> particles;
-	static std::vector <std::vector<std::unordered_map<int, bool>>> cells;
+	static SparseGrid cells;                                // s_Radius cells of the particle indices
+	static std::vector <Span<int>> neighborLists;          // indices within s_Radius in the step's arenas, filled by gatherNeighbors
 
+	// stepped by the other solvers; the SPH solver loads them and steps its own state, see SphSolver::View
 	glm::vec3 pos;
 	glm::vec3 predictedPos;
 	
@@ -27,6 +38,8 @@ public:
 	glm::vec3 acceleration;
 	float density;
 	float nearDensity;
+	float viscosityRate;   // viscosity coefficient summed over the neighbors, limits the step size
+	float scale;           // radius and smoothing length relative to radius and s_Radius, 1 unless +multires
 
 	static int numOfParticles;
 	static int segments;
@@ -39,24 +52,63 @@ public:
 	static float stepSize;
 	static float spacing;
 
+	// adaptive time stepping: the step is the smallest of the CFL, force and viscosity limits
+	static bool adaptive;
+	static bool leapfrog;
+	static bool doublePrecision;     // run the SPH step in double, for validation
+	static bool localSteps;          // per particle power of two steps for the SPH step
+	static bool fusedForces;         // kick in the SPH force pass instead of a pass of its own
+	static bool fastMath;            // SPH kernels from squared distances and approximate rsqrt
+	static bool cellTiles;           // SPH neighbor sums by cell pairs over copies in the cells' order
+	static bool compactStorage;      // SPH tiles read 16 bit packed particles instead of full precision copies
+	static int cellDivisions;        // SPH cells per smoothing length, 1 to 3, 0 chooses from the density
+	static int maxRung;              // longest local step is 2^maxRung steps
+	static int periodic;             // bit k wraps axis k (x, y, z) of the SPH step instead of its walls
+	static float cflNumber;
+	static float forceNumber;
+	static float viscosityNumber;
+	static float minStepSize;
+	static float maxStepSize;
+	static float dt;                 // size of the last step
+	static const char* dtLimit;      // criterion that chose it
+	static double simulatedTime;
+	static int numSteps;
+
 	static unsigned int vao;
 	static unsigned int vbo;
 	static unsigned int ibo;
+	static unsigned int instanceVbo;
+
+	// level of detail meshes: first index and index count of each disc
+	static int lodFirst[3];
+	static int lodCount[3];
+	static int numVisible;
+	static int numSplats;
 
 	static void generateRandomCenters();
 	static void generateGridCenters(int rows, int cols);
 	static void populate(float aspectRatio);
-	static void updateCell(int idx, int prevRow, int prevCol);
-	static std::vector<Particle> findNeighbors(int idx);
-	void generateParticle(float aspectRatio);
-	static glm::vec3 pressure(int idx);
-	static glm::vec3 viscosity(int idx, std::vector<Particle> neighbors);
-	static void calcuateDensities(int idx);
+	static void updateCell(int idx);
+	static void resetCells();        // empty, sized to s_Radius
+	static void rebuildCells();
+	static int count();              // the particles being stepped, in the SPH solver's state once it has them
+	static void gatherNeighbors();
+	static void generateParticle(float aspectRatio, int segs);
+	static void step();
 	static float densityKernel(float dst);
-	static float nearDensityKernel(float dst);
 	static float pressureKernel(float dst);
-	static float nearPressureKernel(float dst);
-	static float viscosityKernel(float dst);
 //	static void drawElements(Window window, int object_Location, int color_Location);
-	static void drawElements(Window window, int object_Location, int color_Location, bool bDraw);
+	static void drawElements(int object_Location, int color_Location);
 };
+
+// what drawing and the surface read of particle i, from Particle; SphSolver::View reads the SPH solver's state
+struct ParticleView
+{
+	int count() const { return (int)Particle::particles.size(); }
+	glm::vec3 pos(int i) const { return Particle::particles[i].pos; }
+	glm::vec3 velocity(int i) const { return Particle::particles[i].velocity; }
+	float scale(int i) const { return Particle::particles[i].scale; }
+};
+
+void checkBoundary(Particle& p);
+glm::vec3 speedToColor(float speed);
@@ -0,0 +1,27 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include<GLM/glm.hpp>
+#include<vector>
+#include "../HeaderFiles/Particle.h"
+
+// Position Based Fluids: positions are predicted from gravity alone, then moved by a
+// few Jacobi iterations until every particle's density constraint rho / rho0 - 1 <= 0
+// holds. Velocities are derived from the corrected positions. There is no stiff pressure
+// force to limit the step, so it takes larger steps than the SPH solver, at the cost of the iterations.
+class Pbf
+{
+public:
+	static int iterations;
+	static float stepSize;
+	static float restDensity;    // denser than targetDensity: the constraints need ~20 neighbors to push against
+	static float relaxation;     // constraint force mixing, softens the solve where gradients are small
+	static float xsph;           // XSPH velocity smoothing
+
+	static std::vector <float> lambdas;
+	static std::vector <glm::vec3> deltas;
+	static float densityError;   // mean relative compression after the last iteration
+
+	static void solveDensity();
+	static void step();
+};
@@ -13,9 +13,16 @@ public:
         std::string vertexSource;
         std::string fragmentSource;
     };
-    
+
+    // Basic.shader, embedded at build time
+    static const char* basicSource;
+    static bool cacheHit;
+
     static shaderProgramSource parse(const std::string filePath);
+    static shaderProgramSource split(const std::string& source);
     static unsigned int compile(unsigned int type, const std::string& source);
-    static unsigned int create(const std::string& vertexShader, const std::string& fragmentShader);
+    static unsigned int create(const std::string& vertexShader, const std::string& fragmentShader, bool retrievable = false);
+    static unsigned int createCompute(const std::string& computeShader);
+    static unsigned int load(const shaderProgramSource& source, const std::string& cachePath);
 };
 
@@ -0,0 +1,25 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include<GLM/glm.hpp>
+#include<vector>
+#include "../HeaderFiles/Particle.h"
+
+// Sleeping cells for the SPH solver. A cell of the solver's grid whose particles all stay
+// below sleepSpeed, and whose mean density changes by less than densityChange of the target
+// per step, for sleepSteps steps in a row falls asleep: its particles are frozen and skip the
+// drift, density and force passes, while their last densities still push on the awake
+// particles around them. A sleeping cell wakes when a particle enters or leaves it, or when
+// a cell next to it has a particle faster than wakeSpeed or an obstacle binned in it.
+class Sleep
+{
+public:
+	static bool enabled;
+	static float sleepSpeed;        // units per s
+	static float wakeSpeed;
+	static float densityChange;     // fraction of targetDensity per step
+	static int sleepSteps;
+
+	template <int D, typename T>
+	static void update();
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include<GLM/glm.hpp>
+#include<vector>
+
+// The 2D cell map of the particles, for drawing, the surface and the 2D solvers' neighbor
+// searches. Cells of cellSize from -1 go on without bounds in every direction, and are stored
+// in 8x8 blocks found through a hash of the block's position. A block exists only while one
+// of its cells holds a particle, and a bitmap of its occupied cells lets a walk skip the empty
+// ones, so the memory follows the fluid instead of the domain. Freed blocks are reused with
+// their cells' capacity and the hash is an open-addressed table, so once the fluid has spread
+// out, moving particles between cells does not allocate. A cell that fills up grows to twice its
+// count, and new blocks start at the largest such capacity. Not safe to update concurrently.
+class SparseGrid
+{
+public:
+	enum { BLOCK = 8 };                         // cells along each edge of a block
+	struct Block
+	{
+		glm::ivec2 origin;                      // first cell along x and y
+		unsigned long long occupied;            // bit x + BLOCK * y for every cell holding a particle, 0 when free
+		std::vector <int> cells[BLOCK * BLOCK];
+	};
+
+	struct Slot
+	{
+		unsigned long long key;
+		int block;                              // -1 when empty
+	};
+
+	float cellSize;
+	int cellCapacity;                           // reserved in the cells of a new block, twice the fullest cell so far
+	std::vector <Block> blocks;                 // including free ones, waiting for reuse
+	std::vector <int> freeBlocks;
+	std::vector <Slot> blockIndex;              // linear probing, at most half full
+	int numFiled;
+	std::vector <glm::ivec2> filed;             // the cell each particle is in
+
+	SparseGrid() : cellSize(0.0f), cellCapacity(0), numFiled(0) {}
+
+	int cellOf(float coordinate) const { return (int)std::floor((coordinate + 1.0f) / cellSize); }
+	void reset(float size, int capacity);        // keeps a larger grown capacity if the size is the same
+	void insert(int index, glm::vec2 pos);
+	void move(int index, glm::vec2 pos);
+	void erase(int index);
+	const std::vector <int>& cell(int x, int y) const;
+	int numBlocks() const { return (int)(blocks.size() - freeBlocks.size()); }
+	size_t footprint() const;
+
+private:
+	static unsigned long long key(int bx, int by) { return (unsigned long long)(unsigned int)bx << 32 | (unsigned int)by; }
+	static int blockOf(int c) { return c >= 0 ? c / BLOCK : (c + 1) / BLOCK - 1; }
+	int home(unsigned long long k) const { return (int)((k * 0x9E3779B97F4A7C15ull) >> 32) & ((int)blockIndex.size() - 1); }
+	int find(unsigned long long k) const;
+	void file(unsigned long long k, int b);
+	void unfile(unsigned long long k);
+	std::vector <int>& add(int x, int y);
+	void grow(std::vector <int>& cell);
+	void remove(int index, int x, int y);
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include<GLM/glm.hpp>
+#include<vector>
+#include "../HeaderFiles/Particle.h"
+
+// Three dimensional SPH in a tank: the 2D box in x and y, depth in z. The step is
+// SphSolver<3, T>, the same SPH step as 2D with kernels normalised in 3D, and its
+// state is drawn as shaded point sprites through the orbiting Camera.
+class Sph3d
+{
+public:
+	static bool enabled;
+	static int blockSize;          // particles along each edge of the initial block
+	static float depth;            // half depth of the tank in z
+	static float targetDensity;    // same fraction of the initial block's density as the 2D targetDensity
+
+	static unsigned int program;
+	static unsigned int vao;
+	static unsigned int vbo;
+	static std::vector <float> vertices;   // position.xyz, color.rgb, size per particle, then the box edges
+
+	static int maxBlock();         // largest blockSize that fits in the tank
+	static void populate();
+	static void step();
+	static bool initRenderer();
+	static void drawElements();
+};
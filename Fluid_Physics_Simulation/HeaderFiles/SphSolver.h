@@ -0,0 +1,227 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include<GLM/glm.hpp>
+#include<vector>
+#include "../HeaderFiles/Particle.h"
+
+// The SPH step (pressure, near pressure, viscosity, leapfrog, adaptive step size) for a dimension
+// (2 or 3) and a scalar type (float, or double for validation). The solver loads Particle::particles
+// once and steps its own state in D components of T; drawing and the surface read that state through
+// View, nothing is copied back per step. Multires gives the particles their own mass and smoothing
+// length, Sleep freezes quiet cells, local steps give particles on rung r new forces every 2^r steps,
+// Emitters makes the particles a pool and periodic axes wrap them. Without local steps the kick is
+// fused into the force pass. +tiles sums the neighbors by cell pairs, +compact from packed particles.
+// Explicitly instantiated in SphSolver.cpp for <2, float>, <3, float>, <2, double> and <3, double>.
+template <int D, typename T>
+class SphSolver
+{
+public:
+	typedef glm::vec<D, T, glm::defaultp> vec;
+
+	struct State
+	{
+		vec pos;
+		vec predictedPos;
+		vec velocity;
+		vec acceleration;
+		T density;
+		T nearDensity;
+		T viscosityRate;
+		T mass;             // 2^level, 1 unless Multires is on
+		T h;                // smoothing length, s_Radius * 2^(level / D)
+		T vorticity;        // magnitude of the velocity curl, only computed for Multires
+		T surface;          // color field gradient times h: 0 in the bulk, about 1 at the free surface, Multires only
+		int level;
+		int age;            // steps since the last split or merge
+		bool asleep;        // frozen in a sleeping cell, see Sleep, and always in a dead slot
+		bool alive;         // false in a dead slot of the Emitters pool
+		int rung;           // local steps: forces every 2^rung steps, always 0 otherwise
+		int neighborRung;   // smallest rung among the neighbors at the last force evaluation
+		T elapsed;          // time drifted since the last force evaluation
+		T opened;           // part of the step the leapfrog kick that opened it covered
+	};
+
+	static std::vector <State> particles;
+
+	// what drawing and the surface read of particle i, see ParticleView
+	static glm::vec3 widen(const vec& v) {
+		glm::vec3 w(0.0f);
+		for (int k = 0; k < D; k++) w[k] = (float)v[k];
+		return w;
+	}
+	struct View
+	{
+		int count() const { return (int)particles.size(); }
+		glm::vec3 pos(int i) const { return widen(particles[i].pos); }
+		glm::vec3 velocity(int i) const { return widen(particles[i].velocity); }
+		float scale(int i) const { return (float)particles[i].h / Particle::s_Radius; }
+	};
+
+	// The cells a particle's neighbors can be in: offsets lo to hi from its cell along each axis,
+	// and the squared gap in cells from the particle to each row of cells, so that corner cells out
+	// of reach are skipped with two adds. The uniform block is that of as many rings around the cell as
+	// the cells divide the largest smoothing length.
+	enum { MAX_REACH = 8 };
+	struct CellBlock
+	{
+		glm::ivec3 lo;
+		glm::ivec3 hi;
+		T gap[3][2 * MAX_REACH + 2];
+		T range2;
+	};
+
+	// cells of the smallest smoothing length, numbered from the box's lower corner without bounds
+	// and stored only where particles are: the sort orders the particles by the key of their cell,
+	// and a hash table finds a cell from its coordinates. A particle that got out of the box has a
+	// cell of its own wherever it is. On a periodic axis the cells are stretched to tile the period,
+	// and a cell past it stands for the real cell a period away: the search reads that cell's particles
+	// and moves them by the period, no ghost particles are stored.
+	enum { KEY_BITS = 21 };                    // per axis, coordinates beyond +-2^20 share the last cell
+	static T cellSize;
+	static vec cellWidth;                      // along each axis, cellSize or more on periodic axes
+	static T maxSmoothing;
+	static T maxDrift;                         // farthest a predicted position is from the position it was sorted by
+	static int reach;                          // cells from a particle's cell to the farthest a block goes
+	static glm::ivec3 period;                  // cells per period on the periodic axes, 0 on the others
+	static CellBlock uniformBlock;
+	// the uniform block's cells within a smoothing length and twice the drift of the home cell, row by row: a run is the cells in a row from first
+	// past the home cell, one range of the sort, split into single cells when x is periodic
+	struct Run
+	{
+		glm::ivec3 first;
+		int cells;
+	};
+	static std::vector <Run> runs;
+	// the occupied cells in key order, which is row by row, their particles from cellStart on in sorted
+	static std::vector <unsigned long long> cellKeys;
+	static std::vector <glm::ivec3> cellCoords;
+	static std::vector <int> cellStart;
+	static std::vector <int> rowStart;         // the first occupied cell of every row of cells, and the cell count
+	static std::vector <int> sorted;
+	static std::vector <int> particleCell;     // the particle's occupied cell, -1 for a dead slot
+	// the range of the sort each run of every occupied cell covers, and what the positions read through
+	// it are moved by, empty without periodic axes
+	struct Range
+	{
+		int from;
+		int to;
+		int cell;      // the occupied cell from starts, where +compact unpacks from
+	};
+	static std::vector <Range> neighborRanges;
+	static std::vector <vec> neighborShifts;
+	// +compact: what the tile passes read of a particle, packed once per pass in the cells' order in place of
+	// the copies. A position is 16 bits per axis across its cell and the drift either side, the rest are fp16
+	// halves, the density as its compression over the rest density, which keeps the small differences the
+	// pressure comes from. With Multires the level stands for the mass and the smoothing length.
+	struct PackedMotion
+	{
+		unsigned short velocity[D];
+		unsigned short compression;    // density / targetDensity - 1
+		unsigned short nearDensity;
+		unsigned char rung;
+	};
+	enum { LEVELS = 7 };    // Multires::maxLevel is at most 6 above minLevel
+	struct Packed
+	{
+		unsigned short* offsets;       // D per particle
+		PackedMotion* motions;
+		signed char* levels;
+		T levelSmoothing[LEVELS];      // by level above Multires::minLevel
+		T levelMass[LEVELS];
+	};
+	// what the tile sums read, by the index of the pairs: the copies in the cells' order, or with Compact the
+	// rows of cells a row of cells' blocks cover, unpacked into T
+	struct TileArrays
+	{
+		vec* position;
+		vec* velocity;
+		T* smoothing;
+		T* mass;
+		T* density;
+		T* nearDensity;
+		int* rung;
+	};
+	static std::vector <unsigned long long> tableKeys;     // open addressing, twice the particles' capacity
+	static std::vector <int> tableCells;
+
+	static vec lower;       // box corners
+	static vec upper;
+	static T targetDensity;
+	static int substep;     // steps since load, aligns the rungs
+	static T tightest;      // the smallest of the particles' step limits at the last kick
+	static T heldStep;      // +local +adaptive: the step chosen where the rungs last lined up
+	static bool loaded;     // Particle::particles copied in, which the first step does
+	static bool filed;      // Particle's 2D cell map is up to date with the state
+	static bool reindexed;  // Multires or an Emitters compaction moved particles to other indices since the cells were filed
+
+	// due for new forces at the end of this step, always without local steps
+	static bool due(const State& p) { return ((substep + 1) & ((1 << p.rung) - 1)) == 0; }
+	static bool periodic(int k) { return k < D && (Particle::periodic >> k & 1) != 0; }
+
+	static void load();
+	// the state copied back to Particle::particles, for the GPU check and the summaries
+	static void store();
+	// 2D: the live particles filed in Particle's cell map, once after a step when drawing or the surface needs it
+	static void fileCells();
+	static void buildGrid(T size, int rings);
+	static void buildRuns(T drift);
+	// the block around a position in the home cell or drifted out of it
+	static const CellBlock& blockOf(const vec& pos, const glm::ivec3& home, T range, CellBlock& block);
+	static glm::ivec3 coordOf(const vec& pos);
+	static unsigned long long keyOf(const glm::ivec3& coord);
+	static int slotOf(unsigned long long key);
+	// a cell's coordinates moved into the period along the periodic axes, and the shift of the positions read through it
+	static void wrapCell(glm::ivec3& coord, vec& shift);
+	// the occupied cell at the coordinates, -1 if there is none
+	static int findCell(glm::ivec3 coord, vec& shift);
+	// cells per smoothing length, Particle::cellDivisions or the cheapest for the particles per h^D
+	static int chooseDivisions();
+	static T particleDensity();                    // particles per h^D, the mean density of the last density pass
+	// the pairs the uniform block hands the neighbor loops over the last sort and those within a smoothing
+	// length of each other, with the density, returns the cells per smoothing length
+	static int countPairs(double& density, long long& candidates, long long& neighbors);
+	static void sortCells();
+	static void checkBoundary(State& p);
+	static T stepLimit(T h, T speed, T accel, T rate, const char*& limit);
+	static T adaptiveStepSize();
+	static int chooseRung(const State& p, T dt);
+	// Variable: per particle mass and smoothing length (Multires), otherwise 1 and s_Radius.
+	// Fast: +fastmath, squared distances and rsqrt instead of sqrt and divisions.
+	template <bool Variable, bool Fast> static void calculateDensities();
+	// Fused: every particle is kicked and clamped as soon as its forces are done, and the neighbors'
+	// velocities are read from the snapshot the drift took, so the result is the same as kicking
+	// in a pass of its own. Returns the particles kicked, 0 when not Fused.
+	template <bool Variable, bool Fused, bool Fast> static int calculateForces(const vec* velocities, T kick);
+	// densities and forces, fast or exact as Particle::fastMath says
+	// +tiles: the same sums walked by cell pairs instead of by particle. What the sums read is copied into
+	// the cells' order once per pass, then every cell's particles are tested against each run of its block
+	// without a branch, into lists of the pairs within reach, and the sums go down the lists with the exact
+	// tests as masks.
+	// Compact: the sums read the packed particles, unpacked a row of cells at a time.
+	template <bool Variable, bool Compact, bool Fast> static void tileDensities();
+	template <bool Variable, bool Fused, bool Compact, bool Fast> static int tileForces(const vec* velocities, T kick);
+	static void packPosition(const vec& pos, int cell, unsigned short* offset);
+	// the packed particles the runs of the cells first to last cover into block, and by how much each run's
+	// range of the sort is ahead of its part of block, the home cells' own after the runs; Motion: the
+	// velocities, densities and rungs as well
+	template <bool Variable, bool Motion> static void unpackRow(int first, int last, const Packed& packed, int* delta, TileArrays& block);
+	// the container, and the acceleration and the fused kick once a particle's sums are done
+	static void finishDensity(State& p, T density, T nearDensity);
+	template <bool Fused> static void finishForces(State& p, vec force, vec viscosity, T rate, T kick);
+	template <bool Variable, bool Fused> static int calculate(const vec* velocities, T kick);
+	static int kickAll(T dt, T kick);
+	static void step();
+	// -fastcheck: steps with the mode off, comparing the densities and forces of
+	// every step with the ones it gives, relative to the rest density and the largest force. Passes
+	// when no more than the outliers fraction of the particles is off by the tolerance or more.
+	static bool validate(int steps, bool& mode, const char* name, double tolerance, double outliers);
+	// -localcheck: steps with the mode off, then as many again from the same state with it on, and passes
+	// when every position and velocity comes out the same bit for bit
+	static bool compare(int steps, bool& mode, const char* name);
+};
+
+extern template class SphSolver<2, float>;
+extern template class SphSolver<3, float>;
+extern template class SphSolver<2, double>;
+extern template class SphSolver<3, double>;
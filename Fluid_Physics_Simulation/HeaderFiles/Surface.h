@@ -0,0 +1,34 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include<GLM/glm.hpp>
+#include<vector>
+#include<string>
+#include "../HeaderFiles/Particle.h"
+
+// Resamples the particle fluid onto a regular grid covering [-1,1] and
+// extracts the free surface (density iso-line) as polylines.
+class Surface
+{
+public:
+	static int resolution;
+	static float isoLevel;
+
+	static std::vector <float> density;
+	static std::vector <glm::vec2> velocity;
+
+	// polylines are stored back to back, polyStarts/polyCounts index into vertices (x, y pairs)
+	static std::vector <float> vertices;
+	static std::vector <float> polySpeeds;
+	static std::vector <int> polyStarts;
+	static std::vector <int> polyCounts;
+
+	static unsigned int vao;
+	static unsigned int vbo;
+
+	static void resample();
+	static void extract();
+	static void drawElements(int object_Location, int color_Location);
+	static bool exportOBJ(const std::string& filePath);
+	static size_t footprint();
+};
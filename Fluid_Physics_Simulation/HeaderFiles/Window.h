@@ -17,6 +17,7 @@ public:
 	static unsigned int vbo;
 	static unsigned int vao;
 	static std::vector<float> recData;
-	Window(int w, int h, bool waitVSnyc = true);
+	static std::vector<int> recLoops;      // first vertex and vertex count of each line loop in recData
+	Window(int w, int h, bool waitVSnyc = true, int glMajor = 0, int glMinor = 0, bool visible = true);
 	static void drawBoundary(int object_Location, int color_Location);
 };
\ No newline at end of file
@@ -2,13 +2,18 @@
 #version 330 core
 
 layout (location = 0) in vec4 position;
+layout (location = 1) in vec3 instance;      // center.xy, scale
+layout (location = 2) in vec3 instanceColor;
 uniform vec4 u_pos;
+uniform vec4 u_View;                         // camera center.xy, zoom
+
+out vec3 v_Color;
 
 void main ()
 {
-	vec4 pos = position;
-	pos += u_pos;
-    gl_Position = pos;
+	vec2 pos = position.xy * instance.z + instance.xy + u_pos.xy;
+	gl_Position = vec4((pos - u_View.xy) * u_View.z, 0.0, 1.0);
+	v_Color = instanceColor;
 };
 
 #shader fragment
@@ -16,9 +21,10 @@ void main ()
 
 layout (location = 0) out vec4 color;
 
+in vec3 v_Color;
 uniform vec3 u_Color;
 
 void main ()
 {
-	color = vec4(u_Color, 1.0f);
+	color = vec4(u_Color * v_Color, 1.0f);
 };
\ No newline at end of file
@@ -0,0 +1,39 @@
+#shader vertex
+#version 330 core
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 vertexColor;
+layout (location = 2) in float size;         // radius relative to Particle::radius
+uniform mat4 u_ViewProjection;
+uniform float u_PointScale;                  // particle radius in pixels at unit distance
+
+out vec3 v_Color;
+
+void main ()
+{
+	gl_Position = u_ViewProjection * vec4(position, 1.0);
+	gl_PointSize = u_PointScale * size / gl_Position.w;
+	v_Color = vertexColor;
+};
+
+#shader fragment
+#version 330 core
+
+layout (location = 0) out vec4 color;
+
+in vec3 v_Color;
+uniform int u_Sprite;                        // 0 for the box lines
+
+void main ()
+{
+	vec3 shade = v_Color;
+	if (u_Sprite != 0) {
+		// shade the point sprite as a sphere lit from the upper left
+		vec2 n = gl_PointCoord * 2.0 - 1.0;
+		float r2 = dot(n, n);
+		if (r2 > 1.0) discard;
+		vec3 normal = vec3(n.x, -n.y, sqrt(1.0 - r2));
+		shade *= 0.35 + 0.65 * max(dot(normal, normalize(vec3(-0.4, 0.6, 0.7))), 0.0);
+	}
+	color = vec4(shade, 1.0f);
+};
@@ -0,0 +1,11 @@
+# Wraps a shader source in a raw string literal for Shaders.cpp to #include, on any platform with CMake:
+#     cmake -DINPUT=res/shaders/Basic.shader -DOUTPUT=Basic.shader.inl -P scripts/embed.cmake
+if(NOT INPUT OR NOT OUTPUT)
+    message(FATAL_ERROR "embed.cmake needs -DINPUT=<shader> -DOUTPUT=<inl>")
+endif()
+
+file(READ "${INPUT}" source)
+# written next to the output first, so that an unchanged shader leaves the output's timestamp alone
+file(WRITE "${OUTPUT}.tmp" "R\"SHADER(\n${source}\n)SHADER\"\n")
+configure_file("${OUTPUT}.tmp" "${OUTPUT}" COPYONLY)
+file(REMOVE "${OUTPUT}.tmp")
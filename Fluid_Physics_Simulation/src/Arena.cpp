@@ -0,0 +1,191 @@
+#include "../HeaderFiles/Arena.h"
+#include <omp.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+// every heap allocation of the program, counted by the operator new below
+static std::atomic <long long> numAllocations(0);
+
+#ifdef COUNT_ALLOCATIONS
+const bool Arena::counting = true;
+#else
+const bool Arena::counting = false;
+#endif
+
+// one per thread the parallel passes can run on, never freed. Made on first use, which is the reset at
+// the start of the first step, outside any parallel region and after the thread count is settled
+static std::vector <Arena>& arenas() {
+    static std::vector <Arena> all(omp_get_max_threads());
+    return all;
+}
+
+static const size_t ALIGNMENT = 16;
+
+static size_t aligned(size_t bytes) {
+    return (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+Arena& Arena::local() {
+    return arenas()[omp_get_thread_num()];
+}
+
+void Arena::resetAll() {
+    std::vector <Arena>& all = arenas();
+    for (int t = 0; t < all.size(); t++) all[t].reset();
+}
+
+long long Arena::allocations() {
+    return numAllocations.load();
+}
+
+void* Arena::allocBytes(size_t bytes) {
+    bytes = aligned(bytes);
+    if (top + bytes <= capacity) {
+        void* p = base + top;
+        top += bytes;
+        return p;
+    }
+    // a block of its own until the next reset makes room
+    char* p = new char[bytes];
+    spills.push_back(p);
+    spilled += bytes;
+    return p;
+}
+
+void Arena::trimBytes(void* last, size_t bytes) {
+    // only the last buffer taken from the arena itself can shrink
+    char* p = (char*)last;
+    if (p < base || p >= base + top) return;
+    top = (size_t)(p - base) + aligned(bytes);
+}
+
+void Arena::reset() {
+    if (spilled > 0) {
+        // room for everything the last step took, with some to spare
+        size_t used = top + spilled;
+        delete[] base;
+        capacity = aligned(used + used / 2);
+        base = new char[capacity];
+        for (int k = 0; k < spills.size(); k++) delete[] spills[k];
+        spills.clear();
+        spilled = 0;
+    }
+    top = 0;
+}
+
+#ifdef COUNT_ALLOCATIONS
+// counting replacements of the global allocation functions
+void* operator new(std::size_t size) {
+    numAllocations++;
+    void* p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    numAllocations++;
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+#if __cpp_aligned_new
+// over-aligned types, which the library would otherwise take from the heap uncounted; freed with the
+// function that matches the allocation, the MSVC runtime's aligned blocks cannot go to free
+static void* alignedMalloc(std::size_t size, std::size_t alignment) {
+#ifdef _MSC_VER
+    return _aligned_malloc(size ? size : 1, alignment);
+#else
+    void* p = nullptr;
+    return posix_memalign(&p, std::max(alignment, sizeof(void*)), size ? size : 1) == 0 ? p : nullptr;
+#endif
+}
+
+static void alignedFree(void* p) {
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    numAllocations++;
+    void* p = alignedMalloc(size, (std::size_t)alignment);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    numAllocations++;
+    return alignedMalloc(size, (std::size_t)alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return operator new(size, alignment, std::nothrow);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    alignedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+    alignedFree(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    alignedFree(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+    alignedFree(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    alignedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    alignedFree(p);
+}
+#endif
+#endif
@@ -0,0 +1,119 @@
+#include "../HeaderFiles/Camera.h"
+#include <GLM/gtc/matrix_transform.hpp>
+
+//Defining static members
+glm::vec2 Camera::center = glm::vec2(0.0f);
+float Camera::zoom = 1.0f;
+int Camera::width = 1;
+int Camera::height = 1;
+bool Camera::orbit = false;
+float Camera::yaw = 0.6f;
+float Camera::pitch = 0.35f;
+
+static bool   dragging = false;
+static double dragX = 0.0;
+static double dragY = 0.0;
+
+void Camera::attach(GLFWwindow* window, int w, int h) {
+    width = w;
+    height = h;
+    glfwSetScrollCallback(window, scrollCallback);
+    glfwSetCursorPosCallback(window, cursorCallback);
+    glfwSetMouseButtonCallback(window, mouseCallback);
+    glfwSetKeyCallback(window, keyCallback);
+}
+
+void Camera::reset() {
+    center = glm::vec2(0.0f);
+    zoom = 1.0f;
+    yaw = 0.6f;
+    pitch = 0.35f;
+}
+
+void Camera::setUniform(int view_Location) {
+    glUniform4f(view_Location, center.x, center.y, zoom, 0.0f);
+}
+
+float Camera::pixelsPerUnit() {
+    return zoom * height * 0.5f;
+}
+
+void Camera::visibleBounds(glm::vec2& lo, glm::vec2& hi) {
+    lo = center - glm::vec2(1.0f / zoom);
+    hi = center + glm::vec2(1.0f / zoom);
+}
+
+glm::vec2 Camera::screenToWorld(double x, double y) {
+    glm::vec2 clip = glm::vec2(2.0f * (float)x / width - 1.0f, 1.0f - 2.0f * (float)y / height);
+    return center + clip / zoom;
+}
+
+glm::mat4 Camera::projection() {
+    return glm::perspective(fieldOfView, (float)width / (float)height, 0.05f, 20.0f);
+}
+
+glm::mat4 Camera::view() {
+    // far enough at zoom 1 for the whole box to fit the view
+    float distance = 1.3f / std::tan(0.5f * fieldOfView) / zoom + 0.5f;
+    glm::vec3 target = glm::vec3(center, 0.0f);
+    glm::vec3 eye = target + distance * glm::vec3(std::cos(pitch) * std::sin(yaw), std::sin(pitch), std::cos(pitch) * std::cos(yaw));
+    return glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+void Camera::scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
+    // zoom about the cursor so the point under it stays put
+    double x, y;
+    glfwGetCursorPos(window, &x, &y);
+    if (orbit) {
+        zoom = glm::clamp(zoom * std::pow(1.1f, (float)yoffset), 0.25f, 16.0f);
+        return;
+    }
+    glm::vec2 before = screenToWorld(x, y);
+    zoom = glm::clamp(zoom * std::pow(1.1f, (float)yoffset), 0.0625f, 256.0f);
+    glm::vec2 after = screenToWorld(x, y);
+    center += before - after;
+}
+
+void Camera::cursorCallback(GLFWwindow* window, double x, double y) {
+    if (!dragging) return;
+    if (orbit) {
+        yaw -= 0.01f * (float)(x - dragX);
+        pitch = glm::clamp(pitch + 0.01f * (float)(y - dragY), -1.5f, 1.5f);
+    }
+    else
+        center -= screenToWorld(x, y) - screenToWorld(dragX, dragY);
+    dragX = x;
+    dragY = y;
+}
+
+void Camera::mouseCallback(GLFWwindow* window, int button, int action, int mods) {
+    if (button != GLFW_MOUSE_BUTTON_LEFT) return;
+    dragging = (action == GLFW_PRESS);
+    glfwGetCursorPos(window, &dragX, &dragY);
+}
+
+void Camera::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (action == GLFW_RELEASE) return;
+    float pan = 0.1f / zoom;
+    if (orbit) {
+        switch (key) {
+        case GLFW_KEY_LEFT:  yaw -= 0.1f; return;
+        case GLFW_KEY_RIGHT: yaw += 0.1f; return;
+        case GLFW_KEY_UP:    pitch = glm::min(pitch + 0.1f, 1.5f); return;
+        case GLFW_KEY_DOWN:  pitch = glm::max(pitch - 0.1f, -1.5f); return;
+        }
+    }
+    switch (key) {
+    case GLFW_KEY_LEFT:        center.x -= pan; break;
+    case GLFW_KEY_RIGHT:       center.x += pan; break;
+    case GLFW_KEY_UP:          center.y += pan; break;
+    case GLFW_KEY_DOWN:        center.y -= pan; break;
+    case GLFW_KEY_EQUAL:
+    case GLFW_KEY_KP_ADD:      zoom = glm::min(zoom * 1.25f, 256.0f); break;
+    case GLFW_KEY_MINUS:
+    case GLFW_KEY_KP_SUBTRACT: zoom = glm::max(zoom / 1.25f, 0.0625f); break;
+    case GLFW_KEY_R:
+    case GLFW_KEY_HOME:        reset(); break;
+    case GLFW_KEY_L:           lod = !lod; break;
+    }
+}
@@ -0,0 +1,218 @@
+#include "../HeaderFiles/Container.h"
+#include "../HeaderFiles/Particle.h"
+#include "../HeaderFiles/Window.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+//Defining static members
+bool Container::enabled = false;
+std::vector <glm::vec2> Container::vertices;
+std::vector <int> Container::loopStarts;
+std::vector <int> Container::loopCounts;
+glm::vec2 Container::lower = glm::vec2(0.0f);
+glm::vec2 Container::upper = glm::vec2(0.0f);
+float Container::cellSize = 0.0f;
+glm::ivec2 Container::gridSize = glm::ivec2(0);
+std::vector <Container::Sample> Container::grid;
+
+static const float PI = 3.1415926535897932384626433832f;
+
+bool Container::load(const std::string& filePath) {
+    std::ifstream stream(filePath);
+    if (!stream) return false;
+
+    // OBJ indices count from 1 over the whole file, loops are copied out in order
+    std::vector <glm::vec2> points;
+    std::vector <std::vector<int>> loops;
+    std::string line;
+    while (std::getline(stream, line)) {
+        std::istringstream in(line);
+        std::string tag;
+        in >> tag;
+        if (tag == "v") {
+            glm::vec2 v(0.0f);
+            in >> v.x >> v.y;
+            points.push_back(v);
+        }
+        else if (tag == "l" || tag == "f") {
+            // "f" corners may carry texture and normal indices after a slash
+            std::vector <int> loop;
+            std::string corner;
+            while (in >> corner) loop.push_back(atoi(corner.c_str()) - 1);
+            if (loop.size() > 1 && loop.front() == loop.back()) loop.pop_back();
+            if (loop.size() >= 3) loops.push_back(loop);
+        }
+    }
+    if (loops.empty()) return false;
+
+    vertices.clear();
+    loopStarts.clear();
+    loopCounts.clear();
+    lower = glm::vec2(1e9f);
+    upper = glm::vec2(-1e9f);
+    for (int l = 0; l < loops.size(); l++) {
+        loopStarts.push_back((int)vertices.size());
+        loopCounts.push_back((int)loops[l].size());
+        for (int k = 0; k < loops[l].size(); k++) {
+            int index = loops[l][k];
+            if (index < 0 || index >= points.size()) return false;
+            vertices.push_back(points[index]);
+            lower = glm::min(lower, points[index]);
+            upper = glm::max(upper, points[index]);
+        }
+    }
+    // drawn by Window::drawBoundary instead of the box
+    Window::recData.clear();
+    Window::recLoops.clear();
+    for (int i = 0; i < vertices.size(); i++) {
+        Window::recData.push_back(vertices[i].x);
+        Window::recData.push_back(vertices[i].y);
+    }
+    for (int l = 0; l < loopStarts.size(); l++) {
+        Window::recLoops.push_back(loopStarts[l]);
+        Window::recLoops.push_back(loopCounts[l]);
+    }
+    enabled = true;
+    return true;
+}
+
+bool Container::inside(glm::vec2 pos) {
+    // even-odd rule over all loops
+    bool in = false;
+    for (int l = 0; l < loopStarts.size(); l++) {
+        int first = loopStarts[l];
+        int count = loopCounts[l];
+        for (int k = 0, j = count - 1; k < count; j = k++) {
+            glm::vec2 a = vertices[first + k];
+            glm::vec2 b = vertices[first + j];
+            if ((a.y > pos.y) != (b.y > pos.y) && pos.x < a.x + (pos.y - a.y) * (b.x - a.x) / (b.y - a.y))
+                in = !in;
+        }
+    }
+    return in;
+}
+
+float Container::distance(glm::vec2 pos) {
+    float best = 1e9f;
+    for (int l = 0; l < loopStarts.size(); l++) {
+        int first = loopStarts[l];
+        int count = loopCounts[l];
+        for (int k = 0, j = count - 1; k < count; j = k++) {
+            glm::vec2 a = vertices[first + j];
+            glm::vec2 edge = vertices[first + k] - a;
+            float t = glm::clamp(glm::dot(pos - a, edge) / std::max(glm::dot(edge, edge), 1e-12f), 0.0f, 1.0f);
+            best = std::min(best, glm::length(pos - (a + t * edge)));
+        }
+    }
+    return inside(pos) ? best : -best;
+}
+
+void Container::bake() {
+    // nodes from a smoothing length outside the loops, so the sums of every particle inside are complete
+    float h = Particle::s_Radius;
+    cellSize = 0.25f * h;
+    lower -= glm::vec2(h);
+    upper += glm::vec2(h);
+    gridSize = glm::ivec2(glm::ceil((upper - lower) / cellSize)) + 1;
+    upper = lower + glm::vec2(gridSize - 1) * cellSize;
+    grid.assign(gridSize.x * gridSize.y, Sample());
+
+    // solid or fluid at half the node spacing, for integrating the kernels over the solid
+    float fine = 0.5f * cellSize;
+    glm::ivec2 fineSize = 2 * (gridSize - 1) + 1;
+    std::vector <char> solid(fineSize.x * fineSize.y);
+#pragma omp parallel for schedule(dynamic, 4)
+    for (int y = 0; y < fineSize.y; y++)
+        for (int x = 0; x < fineSize.x; x++)
+            solid[x + fineSize.x * y] = !inside(lower + glm::vec2(x, y) * fine);
+
+#pragma omp parallel for schedule(dynamic, 4)
+    for (int y = 0; y < gridSize.y; y++) {
+        for (int x = 0; x < gridSize.x; x++) {
+            grid[x + gridSize.x * y].distance = distance(lower + glm::vec2(x, y) * cellSize);
+        }
+    }
+
+    // the 2D kernels of SphSolver for the uniform smoothing length, over the solid as fluid at rest density
+    float n0 = Particle::targetDensity * fine * fine;
+    float density = 4.0f / (PI * std::pow(h, 8.0f));
+    float pressure = -30.0f / (PI * std::pow(h, 5.0f));
+    float viscosity = 40.0f / (PI * std::pow(h, 5.0f));
+    float nearPressure = -3.0f / h;
+    int reach = (int)std::ceil(h / fine);
+
+#pragma omp parallel for schedule(dynamic, 4)
+    for (int y = 0; y < gridSize.y; y++) {
+        for (int x = 0; x < gridSize.x; x++) {
+            Sample& s = grid[x + gridSize.x * y];
+
+            // pointing up the distance, one sided at the edges of the grid
+            int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, gridSize.x - 1);
+            int y0 = std::max(y - 1, 0), y1 = std::min(y + 1, gridSize.y - 1);
+            glm::vec2 gradient(
+                (grid[x1 + gridSize.x * y].distance - grid[x0 + gridSize.x * y].distance) / ((x1 - x0) * cellSize),
+                (grid[x + gridSize.x * y1].distance - grid[x + gridSize.x * y0].distance) / ((y1 - y0) * cellSize));
+            float length = glm::length(gradient);
+            s.normal = length > 1e-6f ? gradient / length : glm::vec2(0.0f, 1.0f);
+            s.density = s.nearDensity = s.viscosity = 0.0f;
+            s.pressure = s.nearPressure = glm::vec2(0.0f);
+
+            // only nodes within a smoothing length of a wall see any solid
+            if (std::abs(s.distance) >= h) continue;
+            int cx = 2 * x, cy = 2 * y;
+            for (int dy = -reach; dy <= reach; dy++) {
+                for (int dx = -reach; dx <= reach; dx++) {
+                    int fx = cx + dx, fy = cy + dy;
+                    bool isSolid = fx < 0 || fy < 0 || fx >= fineSize.x || fy >= fineSize.y || solid[fx + fineSize.x * fy];
+                    if (!isSolid) continue;
+                    glm::vec2 offset = glm::vec2(dx, dy) * fine;
+                    float dst = glm::length(offset);
+                    if (dst >= h) continue;
+                    float val = h * h - dst * dst;
+                    float near = 1.0f - dst / h;
+                    s.density += n0 * val * val * val * density;
+                    s.nearDensity += n0 * near * near * near;
+                    s.viscosity += n0 * (h - dst) * viscosity;
+                    if (dst < 1e-6f) continue;
+                    glm::vec2 dir = offset / dst;
+                    s.pressure += n0 * dir * (h - dst) * (h - dst) * pressure;
+                    s.nearPressure += n0 * dir * near * near * nearPressure;
+                }
+            }
+        }
+    }
+}
+
+void Container::sample(float x, float y, Sample& s) {
+    // bilinear between the four nodes around, clamped to the grid
+    float u = glm::clamp((x - lower.x) / cellSize, 0.0f, (float)(gridSize.x - 1) - 1e-4f);
+    float v = glm::clamp((y - lower.y) / cellSize, 0.0f, (float)(gridSize.y - 1) - 1e-4f);
+    int i = (int)u, j = (int)v;
+    float fu = u - i, fv = v - j;
+    const Sample& a = grid[i + gridSize.x * j];
+    const Sample& b = grid[i + 1 + gridSize.x * j];
+    const Sample& c = grid[i + gridSize.x * (j + 1)];
+    const Sample& d = grid[i + 1 + gridSize.x * (j + 1)];
+    float wa = (1.0f - fu) * (1.0f - fv), wb = fu * (1.0f - fv), wc = (1.0f - fu) * fv, wd = fu * fv;
+    s.distance = wa * a.distance + wb * b.distance + wc * c.distance + wd * d.distance;
+    s.normal = wa * a.normal + wb * b.normal + wc * c.normal + wd * d.normal;
+    float length = glm::length(s.normal);
+    s.normal = length > 1e-6f ? s.normal / length : glm::vec2(0.0f, 1.0f);
+    s.density = wa * a.density + wb * b.density + wc * c.density + wd * d.density;
+    s.nearDensity = wa * a.nearDensity + wb * b.nearDensity + wc * c.nearDensity + wd * d.nearDensity;
+    s.pressure = wa * a.pressure + wb * b.pressure + wc * c.pressure + wd * d.pressure;
+    s.nearPressure = wa * a.nearPressure + wb * b.nearPressure + wc * c.nearPressure + wd * d.nearPressure;
+    s.viscosity = wa * a.viscosity + wb * b.viscosity + wc * c.viscosity + wd * d.viscosity;
+}
+
+void Container::keepInside(std::vector <float>& centers, float radius) {
+    // spawned particles that would start in or against a wall are dropped
+    int kept = 0;
+    for (int i = 0; i + 1 < centers.size(); i += 2) {
+        if (distance(glm::vec2(centers[i], centers[i + 1])) < radius) continue;
+        centers[kept++] = centers[i];
+        centers[kept++] = centers[i + 1];
+    }
+    centers.resize(kept);
+}
@@ -0,0 +1,200 @@
+#include "../HeaderFiles/Dfsph.h"
+
+//Defining static members
+std::vector <float> Dfsph::factors;
+std::vector <float> Dfsph::densityKappa;
+int Dfsph::densityIterations = 0;
+int Dfsph::divergenceIterations = 0;
+float Dfsph::densityError = 0.0f;
+float Dfsph::divergenceError = 0.0f;
+long long Dfsph::totalDensityIterations = 0;
+long long Dfsph::totalDivergenceIterations = 0;
+
+// scratch buffers reused between steps
+static std::vector <float> kappaStep;
+static std::vector <glm::vec3> deltas;
+
+// spiky kernel gradient at particle i towards j; particles on top of each other get a sideways one
+static glm::vec3 gradient(int i, int j) {
+    glm::vec3 offset = Particle::particles[i].pos - Particle::particles[j].pos;
+    float dst = glm::length(offset);
+    glm::vec3 dir = dst >= 1e-6f ? offset / dst : glm::vec3(i < j ? -1.0f : 1.0f, 0.0f, 0.0f);
+    return Particle::pressureKernel(dst) * dir;
+}
+
+// rate of change of particle i's density under the current velocities
+static float densityRate(int i) {
+    const Span <int>& neighbors = Particle::neighborLists[i];
+    float rate = 0.0f;
+    for (int k = 0; k < neighbors.size(); k++) {
+        int j = neighbors[k];
+        rate += glm::dot(Particle::particles[i].velocity - Particle::particles[j].velocity, gradient(i, j));
+    }
+    return rate;
+}
+
+// v_i -= dt * sum_j (kappa_i + kappa_j) grad W_ij, all from the same velocities
+static void applyPressure(float dt) {
+    std::vector <Particle>& particles = Particle::particles;
+    int count = (int)particles.size();
+
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < count; i++) {
+        const Span <int>& neighbors = Particle::neighborLists[i];
+        glm::vec3 delta = glm::vec3(0.0f);
+        for (int k = 0; k < neighbors.size(); k++) {
+            int j = neighbors[k];
+            delta += (kappaStep[i] + kappaStep[j]) * gradient(i, j);
+        }
+        deltas[i] = delta * dt;
+    }
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) particles[i].velocity -= deltas[i];
+}
+
+void Dfsph::computeDensities() {
+    std::vector <Particle>& particles = Particle::particles;
+    int count = (int)particles.size();
+
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < count; i++) {
+        const Span <int>& neighbors = Particle::neighborLists[i];
+        float density = 0.0f;
+        float gradSum = 0.0f;
+        glm::vec3 gradSelf = glm::vec3(0.0f);
+        for (int k = 0; k < neighbors.size(); k++) {
+            int j = neighbors[k];
+            glm::vec3 grad = gradient(i, j);
+            density += Particle::densityKernel(glm::length(particles[i].pos - particles[j].pos));
+            gradSelf += grad;
+            gradSum += glm::dot(grad, grad);
+        }
+        particles[i].density = density;
+        factors[i] = 1.0f / std::max(glm::dot(gradSelf, gradSelf) + gradSum, 1e-6f);
+    }
+}
+
+void Dfsph::solveDensity(float dt) {
+    int count = (int)Particle::particles.size();
+    float invDt2 = 1.0f / (dt * dt);
+
+    // warm start with half of last step's pressure, stored times dt^2 so it carries over a step size change
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) {
+        kappaStep[i] = 0.5f * densityKappa[i] * invDt2;
+        densityKappa[i] *= 0.5f;
+    }
+    applyPressure(dt);
+
+    int iteration = 0;
+    for (;; iteration++) {
+        float error = 0.0f;
+#pragma omp parallel for schedule(dynamic, 64) reduction(+:error)
+        for (int i = 0; i < count; i++) {
+            // only compression is corrected, the free surface may stay below rest density
+            float predicted = Particle::particles[i].density + dt * densityRate(i);
+            float excess = std::max(predicted - restDensity, 0.0f);
+            kappaStep[i] = excess * invDt2 * factors[i];
+            error += excess;
+        }
+        densityError = error / (count * restDensity);
+        if ((iteration >= minIterations && densityError <= densityThreshold) || iteration >= maxIterations) break;
+
+        applyPressure(dt);
+        for (int i = 0; i < count; i++) densityKappa[i] += kappaStep[i] * dt * dt;
+    }
+    densityIterations = iteration;
+}
+
+void Dfsph::solveDivergence(float dt) {
+    // starts cold: the box boundary reflects velocities, and a warm start there keeps pushing particles off the walls
+    int count = (int)Particle::particles.size();
+
+    int iteration = 0;
+    for (;; iteration++) {
+        float error = 0.0f;
+#pragma omp parallel for schedule(dynamic, 64) reduction(+:error)
+        for (int i = 0; i < count; i++) {
+            float rate = std::max(densityRate(i), 0.0f);
+            kappaStep[i] = rate / dt * factors[i];
+            error += rate;
+        }
+        divergenceError = error * dt / (count * restDensity);
+        if ((iteration >= minIterations && divergenceError <= divergenceThreshold) || iteration >= maxIterations) break;
+
+        applyPressure(dt);
+    }
+    divergenceIterations = iteration;
+}
+
+void Dfsph::step() {
+    std::vector <Particle>& particles = Particle::particles;
+    int count = (int)particles.size();
+    float s_Radius = Particle::s_Radius;
+    if (factors.size() != count) {
+        factors.resize(count);
+        densityKappa.resize(count, 0.0f);
+        kappaStep.resize(count);
+        deltas.resize(count);
+        Particle::gatherNeighbors();
+        computeDensities();
+    }
+    // the lists of the last step went with its arenas, the particles have not moved since
+    else Particle::gatherNeighbors();
+
+    // no stiff equation of state, only the flow speed limits the step
+    float maxSpeed = 0.0f;
+    for (int i = 0; i < count; i++) maxSpeed = std::max(maxSpeed, glm::length(particles[i].velocity));
+    float dt = stepSize;
+    Particle::dtLimit = "max";
+    if (maxSpeed * dt > Particle::cflNumber * s_Radius) dt = Particle::cflNumber * s_Radius / maxSpeed, Particle::dtLimit = "cfl";
+    if (dt < Particle::minStepSize) dt = Particle::minStepSize, Particle::dtLimit = "min";
+
+    // non-pressure forces: XSPH smoothing, then gravity
+    float blend = xsph / restDensity;
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < count; i++) {
+        const Span <int>& neighbors = Particle::neighborLists[i];
+        glm::vec3 smooth = glm::vec3(0.0f);
+        for (int k = 0; k < neighbors.size(); k++) {
+            const Particle& n = particles[neighbors[k]];
+            smooth += (n.velocity - particles[i].velocity) * Particle::densityKernel(glm::length(n.pos - particles[i].pos));
+        }
+        deltas[i] = smooth * blend;
+    }
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) {
+        particles[i].velocity += deltas[i];
+        particles[i].velocity.y -= 200.0f * dt;
+    }
+
+    solveDensity(dt);
+
+    // change position and cell
+    for (int i = 0; i < count; ++i) {
+        Particle& p = particles[i];
+        p.pos += dt * p.velocity;
+        checkBoundary(p);
+        p.predictedPos = p.pos;
+        Particle::updateCell(i);
+    }
+
+    Particle::gatherNeighbors();
+    computeDensities();
+    solveDivergence(dt);
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) {
+        Particle& p = particles[i];
+        float velMag = glm::length(p.velocity);
+        // velocity clamp
+        if (velMag > 15.0f) p.velocity = 15.0f * p.velocity / velMag;
+    }
+
+    totalDensityIterations += densityIterations;
+    totalDivergenceIterations += divergenceIterations;
+    Particle::dt = dt;
+    Particle::simulatedTime += dt;
+    Particle::numSteps++;
+}
@@ -0,0 +1,225 @@
+#include "../HeaderFiles/Emitters.h"
+#include "../HeaderFiles/SphSolver.h"
+#include "../HeaderFiles/Multires.h"
+#include <fstream>
+#include <sstream>
+
+//Defining static members
+bool Emitters::enabled = false;
+int Emitters::capacity = 4000;
+std::vector <Emitters::Emitter> Emitters::emitters;
+std::vector <int> Emitters::freeSlots;
+int Emitters::numLive = 0;
+int Emitters::numSlots = 0;
+long long Emitters::numEmitted = 0;
+long long Emitters::numRemoved = 0;
+long long Emitters::numBlocked = 0;
+int Emitters::numCompactions = 0;
+unsigned int Emitters::vao = 0;
+unsigned int Emitters::vbo = 0;
+
+// outlines, built once
+static std::vector <float> outline;
+
+bool Emitters::load(const std::string& filePath) {
+    std::ifstream stream(filePath);
+    if (!stream) return false;
+
+    emitters.clear();
+    std::string line;
+    while (std::getline(stream, line)) {
+        std::istringstream in(line);
+        std::string tag;
+        if (!(in >> tag) || tag[0] == '#') continue;
+        Emitter e;
+        e.velocity = glm::vec2(0.0f);
+        if (tag == "nozzle") e.kind = NOZZLE;
+        else if (tag == "source") e.kind = SOURCE;
+        else if (tag == "drain") e.kind = DRAIN;
+        else return false;
+        glm::vec2 a, b;
+        if (!(in >> a.x >> a.y >> b.x >> b.y)) return false;
+        if (e.kind != DRAIN && !(in >> e.velocity.x >> e.velocity.y)) return false;
+        e.lower = glm::min(a, b);
+        e.upper = glm::max(a, b);
+        emitters.push_back(e);
+    }
+    if (emitters.empty()) return false;
+
+    // each drawn as a loop of 4 corners, a nozzle's two pairs fall on its segment
+    outline.clear();
+    for (int k = 0; k < emitters.size(); k++) {
+        const Emitter& e = emitters[k];
+        float corners[8] = { e.lower.x, e.lower.y, e.upper.x, e.lower.y, e.upper.x, e.upper.y, e.lower.x, e.upper.y };
+        outline.insert(outline.end(), corners, corners + 8);
+    }
+    enabled = true;
+    return true;
+}
+
+// whether a particle of the last sort is within range of the site, through the solver's cells
+template <int D, typename T>
+static bool occupied(const glm::vec2& site, T range) {
+    typedef SphSolver<D, T> Solver;
+    typedef typename Solver::vec vec;
+    int lo[2], hi[2];
+    for (int k = 0; k < 2; k++) {
+        lo[k] = (int)std::floor(((T)site[k] - range - Solver::lower[k]) / Solver::cellWidth[k]);
+        hi[k] = (int)std::floor(((T)site[k] + range - Solver::lower[k]) / Solver::cellWidth[k]);
+    }
+    for (int y = lo[1]; y <= hi[1]; y++) {
+        for (int x = lo[0]; x <= hi[0]; x++) {
+            vec shift = vec(T(0));
+            int c = Solver::findCell(glm::ivec3(x, y, 0), shift);
+            if (c < 0) continue;
+            for (int k = Solver::cellStart[c]; k < Solver::cellStart[c + 1]; k++) {
+                const typename Solver::State& p = Solver::particles[Solver::sorted[k]];
+                if (!p.alive) continue;
+                T dx = p.pos[0] + shift[0] - (T)site.x, dy = p.pos[1] + shift[1] - (T)site.y;
+                if (dx * dx + dy * dy < range * range) return true;
+            }
+        }
+    }
+    return false;
+}
+
+template <int D, typename T>
+void Emitters::update() {
+    typedef SphSolver<D, T> Solver;
+    typedef typename Solver::State State;
+    typedef typename Solver::vec vec;
+    std::vector <State>& particles = Solver::particles;
+    int count = (int)particles.size();
+
+    // the free list only follows the slots while nothing else moves particles between them
+    freeSlots.reserve(capacity);
+    if (count != numSlots || Multires::enabled) {
+        freeSlots.clear();
+        numLive = 0;
+        for (int i = 0; i < count; i++) {
+            if (particles[i].alive) numLive++;
+            else freeSlots.push_back(i);
+        }
+    }
+
+    // sinks: the drains, and anything that got out of the box, which SphSolver::checkBoundary leaves out
+    for (int i = 0; i < count; i++) {
+        State& p = particles[i];
+        if (!p.alive) continue;
+        glm::vec2 pos((float)p.pos[0], (float)p.pos[1]);
+        bool remove = !(p.pos[0] >= Solver::lower[0] && p.pos[0] <= Solver::upper[0] &&
+                        p.pos[1] >= Solver::lower[1] && p.pos[1] <= Solver::upper[1]);
+        for (int k = 0; k < emitters.size() && !remove; k++) {
+            const Emitter& e = emitters[k];
+            remove = e.kind == DRAIN && pos.x >= e.lower.x && pos.x <= e.upper.x && pos.y >= e.lower.y && pos.y <= e.upper.y;
+        }
+        if (!remove) continue;
+        // a dead slot sleeps, so that every pass skips it, and leaves the 2D cells
+        p.alive = false;
+        p.asleep = true;
+        p.velocity = vec(T(0));
+        p.acceleration = vec(T(0));
+        Particle::cells.erase(i);
+        freeSlots.push_back(i);
+        numLive--;
+        numRemoved++;
+    }
+
+    // emitters: every site no particle is within a spacing of gets one, a nozzle's next row
+    // as soon as the last one has moved a spacing on
+    T step = (T)(2.0f * Particle::radius + Particle::spacing);
+    for (int k = 0; k < emitters.size(); k++) {
+        const Emitter& e = emitters[k];
+        if (e.kind == DRAIN) continue;
+        glm::ivec2 sites = glm::ivec2(glm::floor((e.upper - e.lower) / (float)step)) + 1;
+        for (int sy = 0; sy < sites.y; sy++) {
+            for (int sx = 0; sx < sites.x; sx++) {
+                glm::vec2 site = e.lower + glm::vec2(sx, sy) * (float)step;
+                if (occupied<D, T>(site, step)) continue;
+                int slot;
+                if (!freeSlots.empty()) slot = freeSlots.back(), freeSlots.pop_back();
+                else if (particles.size() < capacity) {
+                    // within the reserved capacity, so no allocation
+                    slot = (int)particles.size();
+                    particles.push_back(State());
+                }
+                else {
+                    numBlocked++;
+                    continue;
+                }
+                State& p = particles[slot];
+                p.pos = vec(T(0));
+                p.pos[0] = (T)site.x;
+                p.pos[1] = (T)site.y;
+                p.predictedPos = p.pos;
+                p.velocity = vec(T(0));
+                p.velocity[0] = (T)e.velocity.x;
+                p.velocity[1] = (T)e.velocity.y;
+                p.acceleration = vec(T(0));
+                p.density = Solver::targetDensity;
+                p.nearDensity = T(0);
+                p.viscosityRate = T(0);
+                p.mass = T(1);
+                p.h = (T)Particle::s_Radius;
+                p.vorticity = T(0);
+                p.surface = T(0);
+                p.level = 0;
+                p.age = 0;
+                p.asleep = false;
+                p.alive = true;
+                p.rung = 0;
+                p.neighborRung = 0;
+                p.elapsed = T(0);
+                p.opened = T(0);
+                numLive++;
+                numEmitted++;
+            }
+        }
+    }
+
+    // compaction in order, which keeps neighbors close in memory; the 2D cells are filed again, see SphSolver::fileCells
+    count = (int)particles.size();
+    if (freeSlots.size() > std::max(count / 4, 64)) {
+        int kept = 0;
+        for (int i = 0; i < count; i++) {
+            if (!particles[i].alive) continue;
+            if (kept != i) particles[kept] = particles[i];
+            kept++;
+        }
+        particles.resize(kept);
+        Solver::reindexed = true;
+        freeSlots.clear();
+        numCompactions++;
+    }
+    numSlots = (int)particles.size();
+}
+
+int Emitters::liveCount() {
+    return enabled ? numLive : Particle::count();
+}
+
+void Emitters::drawElements(int object_Location, int color_Location) {
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, outline.size() * sizeof(float), outline.data(), GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    // not instanced: unit scale, emitters light blue and drains red
+    glVertexAttrib3f(1, 0.0f, 0.0f, 1.0f);
+    glUniform4f(object_Location, 0.0f, 0.0f, 0.0f, 0.0f);
+    for (int k = 0; k < emitters.size(); k++) {
+        glm::vec3 color = emitters[k].kind == DRAIN ? glm::vec3(0.9f, 0.3f, 0.3f) : glm::vec3(0.4f, 0.8f, 1.0f);
+        glVertexAttrib3f(2, color.r, color.g, color.b);
+        glUniform3f(color_Location, color.r, color.g, color.b);
+        glDrawArrays(GL_LINE_LOOP, 4 * k, 4);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+template void Emitters::update<2, float>();
+template void Emitters::update<3, float>();
+template void Emitters::update<2, double>();
+template void Emitters::update<3, double>();
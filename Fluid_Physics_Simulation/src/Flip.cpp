@@ -0,0 +1,516 @@
+#include "../HeaderFiles/Flip.h"
+#include "../HeaderFiles/Arena.h"
+#include <cmath>
+
+//Defining static members
+std::vector <float> Flip::u;
+std::vector <float> Flip::v;
+std::vector <float> Flip::uPrev;
+std::vector <float> Flip::vPrev;
+std::vector <float> Flip::pressure;
+std::vector <char> Flip::cellType;
+std::vector <glm::vec2> Flip::affineX;
+std::vector <glm::vec2> Flip::affineY;
+int Flip::iterations = 0;
+float Flip::residual = 0.0f;
+long long Flip::totalIterations = 0;
+
+// the grid spans the box, [-0.9, 0.9] in both directions
+static const float origin = -0.9f;
+
+static float cellSize() {
+    return 1.8f / (float)Flip::resolution;
+}
+
+// particles sorted by grid cell, rebuilt every step
+static std::vector <int> cellStart;
+static std::vector <int> sorted;
+static std::vector <int> particleCell;
+
+// particle density at the cell centres, and its value in the initial block
+static std::vector <float> cellDensity;
+static float restCellDensity = 0.0f;
+
+// multigrid hierarchy, level 0 is the pressure grid
+struct Level
+{
+    int n = 0;
+    std::vector <char> type;
+    std::vector <float> x;
+    std::vector <float> b;
+    std::vector <float> r;
+    std::vector <float> tmp;
+};
+static std::vector <Level> levels;
+
+// conjugate gradient vectors
+static std::vector <float> rhs;
+static std::vector <float> res;
+static std::vector <float> precond;
+static std::vector <float> dir;
+static std::vector <float> adir;
+
+// extrapolation scratch
+static std::vector <char> valid;
+static std::vector <char> validNext;
+static std::vector <float> extended;
+
+static void sortParticles() {
+    // counting sort, the prefix sum makes this serial but it is a single pass over the particles
+    const std::vector <Particle>& particles = Particle::particles;
+    int n = Flip::resolution;
+    int count = (int)particles.size();
+    float dx = cellSize();
+    cellStart.assign(n * n + 1, 0);
+    sorted.resize(count);
+    particleCell.resize(count);
+
+    for (int i = 0; i < count; i++) {
+        int x = glm::clamp((int)((particles[i].pos.x - origin) / dx), 0, n - 1);
+        int y = glm::clamp((int)((particles[i].pos.y - origin) / dx), 0, n - 1);
+        particleCell[i] = x + y * n;
+        cellStart[particleCell[i] + 1]++;
+    }
+    for (int c = 0; c < n * n; c++) cellStart[c + 1] += cellStart[c];
+    int* cursor = Arena::local().alloc<int>(n * n);
+    std::copy(cellStart.begin(), cellStart.end() - 1, cursor);
+    for (int i = 0; i < count; i++) sorted[cursor[particleCell[i]]++] = i;
+}
+
+// weighted particle velocity (one component) at grid position (fx, fy), with bilinear weights
+static float gather(float fx, float fy, int component, float* weightSum = nullptr) {
+    const std::vector <Particle>& particles = Particle::particles;
+    bool apic = Particle::solver == Particle::SOLVER_APIC;
+    int n = Flip::resolution;
+    float dx = cellSize();
+    int cx = (int)std::floor(fx);
+    int cy = (int)std::floor(fy);
+    float sum = 0.0f;
+    float weight = 0.0f;
+    for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, n - 1); y++) {
+        for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, n - 1); x++) {
+            int cell = x + y * n;
+            for (int k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+                int p = sorted[k];
+                float gx = (particles[p].pos.x - origin) / dx;
+                float gy = (particles[p].pos.y - origin) / dx;
+                float wx = 1.0f - std::abs(gx - fx);
+                float wy = 1.0f - std::abs(gy - fy);
+                if (wx <= 0.0f || wy <= 0.0f) continue;
+                float vel = component == 0 ? particles[p].velocity.x : particles[p].velocity.y;
+                // APIC: the particle's velocity field is affine around it, evaluate it at the face
+                if (apic) vel += glm::dot(component == 0 ? Flip::affineX[p] : Flip::affineY[p], glm::vec2(fx - gx, fy - gy) * dx);
+                sum += wx * wy * vel;
+                weight += wx * wy;
+            }
+        }
+    }
+    if (weightSum) *weightSum = weight;
+    return weight > 0.0f ? sum / weight : 0.0f;
+}
+
+void Flip::transferToGrid() {
+    int n = resolution;
+
+    // every face gathers from the particles around it, so faces can be filled in parallel without atomics
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i <= n; i++) u[i + j * (n + 1)] = (i == 0 || i == n) ? 0.0f : gather((float)i, j + 0.5f, 0);
+    }
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j <= n; j++) {
+        for (int i = 0; i < n; i++) v[i + j * n] = (j == 0 || j == n) ? 0.0f : gather(i + 0.5f, (float)j, 1);
+    }
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            int c = i + j * n;
+            cellType[c] = cellStart[c + 1] > cellStart[c] ? FLUID : AIR;
+            gather(i + 0.5f, j + 0.5f, 0, &cellDensity[c]);
+        }
+    }
+
+    // rest density: the mean over the cells inside the initial block, surface cells are only partly filled
+    if (restCellDensity == 0.0f) {
+        float sum = 0.0f;
+        int count = 0;
+        for (int j = 1; j < n - 1; j++) {
+            for (int i = 1; i < n - 1; i++) {
+                int c = i + j * n;
+                if (cellType[c] == FLUID && cellType[c - 1] == FLUID && cellType[c + 1] == FLUID && cellType[c - n] == FLUID && cellType[c + n] == FLUID)
+                    sum += cellDensity[c], count++;
+            }
+        }
+        restCellDensity = count > 0 ? sum / count : 1.0f;
+    }
+
+    uPrev = u;
+    vPrev = v;
+}
+
+// A x for the pressure Laplacian: walls are left out, air cells hold zero pressure
+static void apply(const Level& level, const std::vector <float>& in, std::vector <float>& out) {
+    int n = level.n;
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            int c = i + j * n;
+            if (level.type[c] != Flip::FLUID) { out[c] = 0.0f; continue; }
+            float diag = 0.0f;
+            float off = 0.0f;
+            if (i > 0)     { diag += 1.0f; if (level.type[c - 1] == Flip::FLUID) off += in[c - 1]; }
+            if (i < n - 1) { diag += 1.0f; if (level.type[c + 1] == Flip::FLUID) off += in[c + 1]; }
+            if (j > 0)     { diag += 1.0f; if (level.type[c - n] == Flip::FLUID) off += in[c - n]; }
+            if (j < n - 1) { diag += 1.0f; if (level.type[c + n] == Flip::FLUID) off += in[c + n]; }
+            out[c] = diag * in[c] - off;
+        }
+    }
+}
+
+// damped Jacobi, the same number of sweeps before and after the coarse correction keeps the V-cycle symmetric
+static void smooth(Level& level, int sweeps) {
+    int n = level.n;
+    for (int s = 0; s < sweeps; s++) {
+        apply(level, level.x, level.tmp);
+#pragma omp parallel for schedule(static)
+        for (int j = 0; j < n; j++) {
+            for (int i = 0; i < n; i++) {
+                int c = i + j * n;
+                if (level.type[c] != Flip::FLUID) continue;
+                float diag = (float)((i > 0) + (i < n - 1) + (j > 0) + (j < n - 1));
+                level.x[c] += (2.0f / 3.0f) * (level.b[c] - level.tmp[c]) / diag;
+            }
+        }
+    }
+}
+
+static void vcycle(int l) {
+    Level& level = levels[l];
+    std::fill(level.x.begin(), level.x.end(), 0.0f);
+    if (l == (int)levels.size() - 1) {
+        smooth(level, 32);
+        return;
+    }
+    smooth(level, 2);
+
+    // coarse right hand side: the sum of the fine residuals, the coarse cells are twice as wide
+    apply(level, level.x, level.tmp);
+    Level& coarse = levels[l + 1];
+    int n = level.n;
+    int nc = coarse.n;
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < nc; j++) {
+        for (int i = 0; i < nc; i++) {
+            float sum = 0.0f;
+            for (int y = 2 * j; y <= std::min(2 * j + 1, n - 1); y++)
+                for (int x = 2 * i; x <= std::min(2 * i + 1, n - 1); x++) {
+                    int c = x + y * n;
+                    if (level.type[c] == Flip::FLUID) sum += level.b[c] - level.tmp[c];
+                }
+            coarse.b[i + j * nc] = coarse.type[i + j * nc] == Flip::FLUID ? sum : 0.0f;
+        }
+    }
+
+    vcycle(l + 1);
+
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            int c = i + j * n;
+            if (level.type[c] == Flip::FLUID) level.x[c] += coarse.x[i / 2 + (j / 2) * nc];
+        }
+    }
+    smooth(level, 2);
+}
+
+static void buildLevels() {
+    // a coarse cell holds zero pressure if any of its children does, so every level stays well posed
+    // the levels of the last step are refilled, so their buffers are reused
+    int n = Flip::resolution;
+    int depth = 1;
+    for (int m = n; m > 4; m = (m + 1) / 2) depth++;
+    levels.resize(depth);
+    levels[0].n = n;
+    levels[0].type = Flip::cellType;
+    for (int l = 1; l < depth; l++) {
+        const Level& fine = levels[l - 1];
+        Level& coarse = levels[l];
+        int nf = fine.n;
+        coarse.n = (nf + 1) / 2;
+        coarse.type.assign(coarse.n * coarse.n, Flip::AIR);
+        for (int j = 0; j < coarse.n; j++) {
+            for (int i = 0; i < coarse.n; i++) {
+                bool air = false;
+                for (int y = 2 * j; y <= std::min(2 * j + 1, nf - 1); y++)
+                    for (int x = 2 * i; x <= std::min(2 * i + 1, nf - 1); x++)
+                        air = air || fine.type[x + y * nf] == Flip::AIR;
+                coarse.type[i + j * coarse.n] = air ? Flip::AIR : Flip::FLUID;
+            }
+        }
+    }
+    for (int l = 0; l < levels.size(); l++) {
+        int cells = levels[l].n * levels[l].n;
+        levels[l].x.assign(cells, 0.0f);
+        levels[l].b.assign(cells, 0.0f);
+        levels[l].r.assign(cells, 0.0f);
+        levels[l].tmp.assign(cells, 0.0f);
+    }
+}
+
+static void precondition(const std::vector <float>& in, std::vector <float>& out) {
+    levels[0].b = in;
+    vcycle(0);
+    out = levels[0].x;
+}
+
+static double dot(const std::vector <float>& a, const std::vector <float>& b) {
+    double sum = 0.0;
+    int size = (int)a.size();
+#pragma omp parallel for schedule(static) reduction(+:sum)
+    for (int i = 0; i < size; i++) sum += (double)a[i] * b[i];
+    return sum;
+}
+
+static float maxAbs(const std::vector <float>& a) {
+    // OpenMP 2.0 has no max reduction
+    float result = 0.0f;
+    int size = (int)a.size();
+#pragma omp parallel
+    {
+        float local = 0.0f;
+#pragma omp for schedule(static)
+        for (int i = 0; i < size; i++) local = std::max(local, std::abs(a[i]));
+#pragma omp critical
+        result = std::max(result, local);
+    }
+    return result;
+}
+
+void Flip::project(float dt) {
+    int n = resolution;
+    int cells = n * n;
+    rhs.resize(cells);
+    res.resize(cells);
+    precond.resize(cells);
+    dir.resize(cells);
+    adir.resize(cells);
+
+    // A p = -divergence, with p scaled by dt / (rho dx) so the update is u -= p_right - p_left.
+    // A divergence free grid does not stop particles from bunching up inside the cells, so
+    // crowded cells get a target divergence that spreads their excess out over the step.
+    float drift = driftCorrection * cellSize() / dt;
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            int c = i + j * n;
+            if (cellType[c] != FLUID) { rhs[c] = 0.0f; pressure[c] = 0.0f; continue; }
+            float excess = std::min(std::max(cellDensity[c] / restCellDensity - 1.0f, 0.0f), 1.0f);
+            rhs[c] = -(u[i + 1 + j * (n + 1)] - u[i + j * (n + 1)] + v[i + (j + 1) * n] - v[i + j * n]) + drift * excess;
+        }
+    }
+
+    buildLevels();
+    const Level& grid = levels[0];
+
+    // conjugate gradient, warm started from the last step's pressure
+    apply(grid, pressure, adir);
+#pragma omp parallel for schedule(static)
+    for (int c = 0; c < cells; c++) res[c] = rhs[c] - adir[c];
+
+    float rhsMax = maxAbs(rhs);
+    float resMax = maxAbs(res);
+    int iteration = 0;
+    if (rhsMax > 0.0f && resMax > tolerance * rhsMax) {
+        precondition(res, precond);
+        dir = precond;
+        double rz = dot(res, precond);
+        for (iteration = 1; iteration <= maxIterations; iteration++) {
+            apply(grid, dir, adir);
+            double dAd = dot(dir, adir);
+            if (dAd <= 0.0) break;
+            float alpha = (float)(rz / dAd);
+#pragma omp parallel for schedule(static)
+            for (int c = 0; c < cells; c++) {
+                pressure[c] += alpha * dir[c];
+                res[c] -= alpha * adir[c];
+            }
+            resMax = maxAbs(res);
+            if (resMax <= tolerance * rhsMax) break;
+
+            precondition(res, precond);
+            double rzNext = dot(res, precond);
+            float beta = (float)(rzNext / rz);
+            rz = rzNext;
+#pragma omp parallel for schedule(static)
+            for (int c = 0; c < cells; c++) dir[c] = precond[c] + beta * dir[c];
+        }
+        iteration = std::min(iteration, maxIterations);
+    }
+    iterations = iteration;
+    residual = rhsMax > 0.0f ? resMax / rhsMax : 0.0f;
+
+    // subtract the pressure gradient from faces next to fluid, the box walls stay closed
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < n; j++) {
+        for (int i = 1; i < n; i++) {
+            int left = i - 1 + j * n;
+            int right = i + j * n;
+            if (cellType[left] == FLUID || cellType[right] == FLUID) u[i + j * (n + 1)] -= pressure[right] - pressure[left];
+        }
+    }
+#pragma omp parallel for schedule(static)
+    for (int j = 1; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            int below = i + (j - 1) * n;
+            int above = i + j * n;
+            if (cellType[below] == FLUID || cellType[above] == FLUID) v[i + j * n] -= pressure[above] - pressure[below];
+        }
+    }
+}
+
+// copies known velocities two faces out into the air, particles near the surface sample there
+static void extrapolateField(std::vector <float>& field, int w, int h, bool uFaces) {
+    int n = Flip::resolution;
+    valid.assign(w * h, 0);
+    for (int j = 0; j < h; j++) {
+        for (int i = 0; i < w; i++) {
+            int a = uFaces ? (i - 1) + j * n : i + (j - 1) * n;
+            int b = i + j * n;
+            bool aIn = uFaces ? i > 0 : j > 0;
+            bool bIn = uFaces ? i < n : j < n;
+            valid[i + j * w] = (aIn && Flip::cellType[a] == Flip::FLUID) || (bIn && Flip::cellType[b] == Flip::FLUID);
+        }
+    }
+
+    for (int layer = 0; layer < 2; layer++) {
+        extended = field;
+        validNext = valid;
+#pragma omp parallel for schedule(static)
+        for (int j = 0; j < h; j++) {
+            for (int i = 0; i < w; i++) {
+                int f = i + j * w;
+                if (valid[f]) continue;
+                float sum = 0.0f;
+                int count = 0;
+                if (i > 0     && valid[f - 1]) sum += field[f - 1], count++;
+                if (i < w - 1 && valid[f + 1]) sum += field[f + 1], count++;
+                if (j > 0     && valid[f - w]) sum += field[f - w], count++;
+                if (j < h - 1 && valid[f + w]) sum += field[f + w], count++;
+                if (count == 0) continue;
+                extended[f] = sum / count;
+                validNext[f] = 1;
+            }
+        }
+        field.swap(extended);
+        valid.swap(validNext);
+    }
+}
+
+void Flip::extrapolate() {
+    int n = resolution;
+    extrapolateField(u, n + 1, n, true);
+    extrapolateField(v, n, n + 1, false);
+}
+
+// bilinear sample of a face grid at grid position (fx, fy), optionally with its gradient in grid units
+static float sample(const std::vector <float>& field, int w, int h, float fx, float fy, glm::vec2* gradient = nullptr) {
+    fx = glm::clamp(fx, 0.0f, (float)(w - 1) - 1e-4f);
+    fy = glm::clamp(fy, 0.0f, (float)(h - 1) - 1e-4f);
+    int i = (int)fx;
+    int j = (int)fy;
+    float tx = fx - i;
+    float ty = fy - j;
+    float f00 = field[i + j * w];
+    float f10 = field[i + 1 + j * w];
+    float f01 = field[i + (j + 1) * w];
+    float f11 = field[i + 1 + (j + 1) * w];
+    if (gradient) {
+        gradient->x = (f10 - f00) * (1.0f - ty) + (f11 - f01) * ty;
+        gradient->y = (f01 - f00) * (1.0f - tx) + (f11 - f10) * tx;
+    }
+    return (f00 * (1.0f - tx) + f10 * tx) * (1.0f - ty) + (f01 * (1.0f - tx) + f11 * tx) * ty;
+}
+
+void Flip::transferToParticles() {
+    std::vector <Particle>& particles = Particle::particles;
+    bool apic = Particle::solver == Particle::SOLVER_APIC;
+    int n = resolution;
+    int count = (int)particles.size();
+    float dx = cellSize();
+
+#pragma omp parallel for schedule(static)
+    for (int p = 0; p < count; p++) {
+        Particle& part = particles[p];
+        float gx = (part.pos.x - origin) / dx;
+        float gy = (part.pos.y - origin) / dx;
+        glm::vec2 gradX, gradY;
+        glm::vec2 pic = glm::vec2(sample(u, n + 1, n, gx, gy - 0.5f, &gradX), sample(v, n, n + 1, gx - 0.5f, gy, &gradY));
+
+        if (apic) {
+            part.velocity = glm::vec3(pic, 0.0f);
+            affineX[p] = gradX / dx;
+            affineY[p] = gradY / dx;
+        }
+        else {
+            // FLIP carries the grid's change over to the particle, a little PIC damps its noise
+            glm::vec2 old = glm::vec2(sample(uPrev, n + 1, n, gx, gy - 0.5f), sample(vPrev, n, n + 1, gx - 0.5f, gy));
+            glm::vec2 flip = glm::vec2(part.velocity) + pic - old;
+            part.velocity = glm::vec3(flipRatio * flip + (1.0f - flipRatio) * pic, 0.0f);
+        }
+
+        float velMag = glm::length(part.velocity);
+        // velocity clamp
+        if (velMag > 15.0f) part.velocity = 15.0f * part.velocity / velMag;
+    }
+}
+
+void Flip::step() {
+    std::vector <Particle>& particles = Particle::particles;
+    int n = resolution;
+    int count = (int)particles.size();
+    float dx = cellSize();
+    if (cellType.size() != n * n) {
+        u.assign((n + 1) * n, 0.0f);
+        v.assign(n * (n + 1), 0.0f);
+        pressure.assign(n * n, 0.0f);
+        cellType.assign(n * n, AIR);
+        cellDensity.assign(n * n, 0.0f);
+        restCellDensity = 0.0f;
+    }
+    affineX.resize(count, glm::vec2(0.0f));
+    affineY.resize(count, glm::vec2(0.0f));
+
+    // the grid carries the pressure, so only the flow speed limits the step
+    float maxSpeed = 0.0f;
+    for (int i = 0; i < count; i++) maxSpeed = std::max(maxSpeed, glm::length(particles[i].velocity));
+    float dt = stepSize;
+    Particle::dtLimit = "max";
+    if (maxSpeed * dt > cflNumber * dx) dt = cflNumber * dx / maxSpeed, Particle::dtLimit = "cfl";
+
+    sortParticles();
+    transferToGrid();
+
+    // gravity, the walls stay closed
+#pragma omp parallel for schedule(static)
+    for (int j = 1; j < n; j++) {
+        for (int i = 0; i < n; i++) v[i + j * n] -= 200.0f * dt;
+    }
+
+    project(dt);
+    extrapolate();
+    transferToParticles();
+
+    // change position and cell
+    for (int i = 0; i < count; ++i) {
+        Particle& p = particles[i];
+        p.pos += dt * p.velocity;
+        checkBoundary(p);
+        p.predictedPos = p.pos;
+        Particle::updateCell(i);
+    }
+
+    totalIterations += iterations;
+    Particle::dt = dt;
+    Particle::simulatedTime += dt;
+    Particle::numSteps++;
+}
@@ -0,0 +1,198 @@
+#include "../HeaderFiles/GpuSolver.h"
+#include "../HeaderFiles/Shaders.h"
+#include "../HeaderFiles/Arena.h"
+#include "../HeaderFiles/SphSolver.h"
+#include <cstddef>
+#include <string>
+#include <algorithm>
+
+//Defining static members
+const char* GpuSolver::source =
+#include "Sph.compute.inl"
+;
+
+bool GpuSolver::enabled = false;
+unsigned int GpuSolver::programs[PASSES] = {};
+unsigned int GpuSolver::particleBuffer = 0;
+unsigned int GpuSolver::cellCountBuffer = 0;
+unsigned int GpuSolver::cellStartBuffer = 0;
+unsigned int GpuSolver::sortedBuffer = 0;
+unsigned int GpuSolver::slotBuffer = 0;
+
+static const int GROUP_SIZE = 128;
+
+// the compute shaders keep a dense grid of s_Radius cells over -1 to 1
+static int gridSize() {
+    return (int)(2.0f / Particle::s_Radius);
+}
+
+static int groups(int n) {
+    return (n + GROUP_SIZE - 1) / GROUP_SIZE;
+}
+
+bool GpuSolver::init() {
+    if (!GLEW_VERSION_4_3 && !GLEW_ARB_compute_shader) return false;
+
+    for (int pass = 0; pass < PASSES; pass++) {
+        std::string code = "#version 430 core\n#define PASS " + std::to_string(pass) + "\n" + source;
+        programs[pass] = Shader::createCompute(code);
+        if (programs[pass] == 0) return false;
+    }
+
+    int size = gridSize();
+    int count = (int)Particle::particles.size();
+    glGenBuffers(1, &particleBuffer);
+    glGenBuffers(1, &cellCountBuffer);
+    glGenBuffers(1, &cellStartBuffer);
+    glGenBuffers(1, &sortedBuffer);
+    glGenBuffers(1, &slotBuffer);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellCountBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size * size * sizeof(unsigned int), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellStartBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size * size * sizeof(unsigned int), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sortedBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(unsigned int), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, slotBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, count * 2 * sizeof(unsigned int), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    upload();
+    return true;
+}
+
+void GpuSolver::upload() {
+    std::vector<GpuParticle> data(Particle::particles.size());
+    for (int i = 0; i < data.size(); i++) {
+        const Particle& p = Particle::particles[i];
+        data[i].pos = glm::vec4(p.pos.x, p.pos.y, 1.0f, 0.0f);
+        data[i].color = glm::vec4(0.0f, 0.5f, 1.0f, 1.0f);
+        data[i].vel = glm::vec4(p.velocity.x, p.velocity.y, 0.0f, 0.0f);
+        data[i].predicted = glm::vec4(p.predictedPos.x, p.predictedPos.y, 0.0f, 0.0f);
+        data[i].accel = glm::vec4(p.acceleration.x, p.acceleration.y, 0.0f, 0.0f);
+        data[i].density = glm::vec4(p.density, p.nearDensity, 0.0f, 0.0f);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, data.size() * sizeof(GpuParticle), data.data(), GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuSolver::download(std::vector<GpuParticle>& out) {
+    out.resize(Particle::particles.size());
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, out.size() * sizeof(GpuParticle), out.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+static void dispatch(int pass, int numGroups) {
+    unsigned int program = GpuSolver::programs[pass];
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "u_Count"), (int)Particle::particles.size());
+    glUniform1i(glGetUniformLocation(program, "u_GridSize"), gridSize());
+    glUniform1f(glGetUniformLocation(program, "u_Radius"), Particle::radius);
+    glUniform1f(glGetUniformLocation(program, "u_SRadius"), Particle::s_Radius);
+    glUniform1f(glGetUniformLocation(program, "u_StepSize"), Particle::stepSize);
+    glUniform1f(glGetUniformLocation(program, "u_TargetDensity"), Particle::targetDensity);
+    glUniform1f(glGetUniformLocation(program, "u_PressureMultiplier"), Particle::pressureMultiplier);
+    glUniform1f(glGetUniformLocation(program, "u_NearPressureMultiplier"), Particle::nearPressureMultiplier);
+    glUniform1f(glGetUniformLocation(program, "u_ViscosityMultiplier"), Particle::viscosityMultiplier);
+    glDispatchCompute(numGroups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void GpuSolver::step() {
+    int current = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, cellCountBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellStartBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, sortedBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, slotBuffer);
+
+    int size = gridSize();
+    int count = (int)Particle::particles.size();
+    dispatch(INTEGRATE, groups(count));
+
+    // counting sort of the particles into cells
+    dispatch(CLEAR, groups(size * size));
+    dispatch(COUNT, groups(count));
+    dispatch(SCAN, 1);
+    dispatch(SCATTER, groups(count));
+
+    dispatch(DENSITY, groups(count));
+    dispatch(FORCE, groups(count));
+    dispatch(UPDATE, groups(count));
+
+    glUseProgram(current);
+
+    // fixed step size, choosing an adaptive one would need a reduction read back every step
+    Particle::dt = Particle::stepSize;
+    Particle::dtLimit = "fixed";
+    Particle::simulatedTime += Particle::dt;
+    Particle::numSteps++;
+}
+
+void GpuSolver::drawElements(int object_Location, int color_Location) {
+    // the renderer reads positions and colors straight from the solver's buffer
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    Metrics::beginCpu(Metrics::CPU_DRAW);
+    glBindVertexArray(Particle::vao);
+    glBindBuffer(GL_ARRAY_BUFFER, particleBuffer);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GpuParticle), (void*)offsetof(GpuParticle, pos));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(GpuParticle), (void*)offsetof(GpuParticle, color));
+
+    glUniform4f(object_Location, 0.0f, 0.0f, 0.0f, 0.0f);
+    glUniform3f(color_Location, 1.0f, 1.0f, 1.0f);
+    glDrawElementsInstanced(GL_TRIANGLES, Particle::lodCount[0], GL_UNSIGNED_INT, (void*)(Particle::lodFirst[0] * sizeof(unsigned int)), (int)Particle::particles.size());
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    Particle::numVisible = (int)Particle::particles.size();
+    Particle::numSplats = 0;
+    Metrics::endCpu(Metrics::CPU_DRAW);
+}
+
+bool GpuSolver::validate(int steps) {
+    // both solvers start from the same state, then run side by side
+    upload();
+    std::vector<GpuParticle> gpu;
+    float maxPos = 0.0f, maxVel = 0.0f, maxDensity = 0.0f;
+    bool pass = true;
+    for (int s = 0; s < steps; s++) {
+        Arena::resetAll();
+        Particle::step();
+        // the CPU solver steps its own state, compared through Particle
+        if (Particle::doublePrecision) SphSolver<2, double>::store();
+        else SphSolver<2, float>::store();
+        step();
+        download(gpu);
+
+        maxPos = maxVel = maxDensity = 0.0f;
+        for (int i = 0; i < gpu.size(); i++) {
+            const Particle& p = Particle::particles[i];
+            maxPos = std::max(maxPos, glm::length(glm::vec2(gpu[i].pos) - glm::vec2(p.pos)));
+            maxVel = std::max(maxVel, glm::length(glm::vec2(gpu[i].vel) - glm::vec2(p.velocity)));
+            maxDensity = std::max(maxDensity, std::abs(gpu[i].density.x - p.density));
+        }
+#if USE_CPP_IOSTREAM
+        std::cout
+            << "GPU check step " << std::setw(4) << s + 1
+            << ": max |dpos| " << std::scientific << std::setprecision(3) << maxPos
+            << "  max |dvel| " << maxVel
+            << "  max |ddensity| " << maxDensity << std::fixed << std::endl;
+#else
+        printf( "GPU check step %4d: max |dpos| %.3e  max |dvel| %.3e  max |ddensity| %.3e\n", s + 1, maxPos, maxVel, maxDensity );
+#endif
+        // every step, relative to the particle radius, the velocity clamp and the rest density
+        pass = pass && maxPos < 1e-2f * Particle::radius && maxVel < 1e-2f * 15.0f && maxDensity < 1e-2f * Particle::targetDensity;
+    }
+
+#if USE_CPP_IOSTREAM
+    std::cout << "GPU check: " << (pass ? "PASSED" : "FAILED") << std::endl;
+#else
+    printf( "GPU check: %s\n", pass ? "PASSED" : "FAILED" );
+#endif
+    return pass;
+}
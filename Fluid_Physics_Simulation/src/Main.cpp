@@ -2,6 +2,21 @@
 #include "../HeaderFiles/Shaders.h"
 #include "../HeaderFiles/Particle.h"
 #include "../HeaderFiles/Window.h"
+#include "../HeaderFiles/Surface.h"
+#include "../HeaderFiles/Camera.h"
+#include "../HeaderFiles/Metrics.h"
+#include "../HeaderFiles/GpuSolver.h"
+#include "../HeaderFiles/Pbf.h"
+#include "../HeaderFiles/Dfsph.h"
+#include "../HeaderFiles/Flip.h"
+#include "../HeaderFiles/Sph3d.h"
+#include "../HeaderFiles/SphSolver.h"
+#include "../HeaderFiles/Multires.h"
+#include "../HeaderFiles/Sleep.h"
+#include "../HeaderFiles/Container.h"
+#include "../HeaderFiles/Obstacles.h"
+#include "../HeaderFiles/Emitters.h"
+#include "../HeaderFiles/Arena.h"
 #include <cmath>
 #include <limits> // MAX_INT
 
@@ -14,6 +29,19 @@ static bool   verbose               = false;
 static bool   vsync                 = true;
 static int    numFirstRenderFrame   = 0;
 static double numLastPhysicsSeconds = 0.0;
+static bool   surface               = false;
+static const char *exportPath       = nullptr;
+static const char *metricsPath      = nullptr;
+static const char *shaderPath       = nullptr;
+static const char *containerPath    = nullptr;
+static const char *flowPath         = nullptr;
+static bool   shaderCache           = true;
+static int    gpuCheckSteps         = 0;
+static int    allocCheckSteps       = 0;
+static int    fastCheckSteps        = 0;
+static int    compactCheckSteps     = 0;
+static int    localCheckSteps       = 0;
+static int    metricsCheckFrames    = 0;
 
 // Defining static variables 
 std::vector <float> Window::recData = {
@@ -22,6 +50,7 @@ std::vector <float> Window::recData = {
      0.9f, -0.9f,
     -0.9f, -0.9f
 };
+std::vector <int> Window::recLoops = { 0, 4 };
 
 std::vector <float> Particle::centers = {};
 
@@ -35,20 +64,149 @@ float Particle::targetDensity = 400.0f;
 float Particle::pressureMultiplier = 200.0f;
 float Particle::nearPressureMultiplier = 1000.0f;
 float Particle::viscosityMultiplier = 0.0002f;
+// opt-in, the fixed symplectic Euler step is the reference the checks and the benchmarks are measured with
+bool Particle::adaptive = false;
+bool Particle::leapfrog = false;
+bool Particle::doublePrecision = false;
+bool Particle::localSteps = false;
+bool Particle::fusedForces = true;
+bool Particle::fastMath = false;
+bool Particle::cellTiles = true;
+bool Particle::compactStorage = false;
+int Particle::cellDivisions = 0;
+int Particle::maxRung = 3;
+int Particle::periodic = 0;
+float Particle::cflNumber = 0.4f;
+float Particle::forceNumber = 0.25f;
+float Particle::viscosityNumber = 0.8f;
+float Particle::minStepSize = 0.0001f;
+float Particle::maxStepSize = 0.004f;
+int Particle::solver = Particle::SOLVER_SPH;
+
+int Pbf::iterations = 4;
+float Pbf::stepSize = 0.002f;
+float Pbf::restDensity = 1000.0f;
+float Pbf::relaxation = 100.0f;
+float Pbf::xsph = 0.05f;
+
+float Dfsph::restDensity = 1000.0f;
+float Dfsph::stepSize = 0.005f;
+float Dfsph::densityThreshold = 0.001f;
+float Dfsph::divergenceThreshold = 0.01f;
+int Dfsph::minIterations = 1;
+int Dfsph::maxIterations = 100;
+float Dfsph::xsph = 0.05f;
+
+int Flip::resolution = 32;
+float Flip::stepSize = 0.005f;
+float Flip::cflNumber = 1.0f;
+float Flip::flipRatio = 0.95f;
+float Flip::driftCorrection = 0.5f;
+float Flip::tolerance = 0.0001f;
+int Flip::maxIterations = 100;
+
+int Sph3d::blockSize = 20;
+float Sph3d::depth = 0.3f;
+float Sph3d::targetDensity = 22000.0f;
+
+bool Multires::enabled = false;
+int Multires::minLevel = 0;
+int Multires::maxLevel = 2;
+float Multires::splitSurface = 1.0f;
+float Multires::mergeSurface = 0.4f;
+float Multires::splitVorticity = 30.0f;
+float Multires::mergeVorticity = 5.0f;
+int Multires::minAge = 40;
+
+bool Sleep::enabled = false;
+bool Obstacles::enabled = false;
+int Obstacles::count = 0;
+
+float Sleep::sleepSpeed = 0.05f;
+float Sleep::wakeSpeed = 0.2f;
+float Sleep::densityChange = 0.001f;
+int Sleep::sleepSteps = 60;
+
+int Surface::resolution = 128;
+float Surface::isoLevel = 200.0f;
+
+bool Camera::lod = true;
+float Camera::pointPixels = 1.0f;
+float Camera::lowPixels = 3.0f;
+float Camera::mediumPixels = 8.0f;
+float Camera::splatPixels = 6.0f;
+int Camera::splatCount = 4;
+float Camera::fieldOfView = 0.785f;
 
 void usage()
 {
     const char *HELP =
 "-?              Display command line options and quit.\n"
 "--help          Alias for -?.\n"
+"-3d             2D simulation (default).\n"
+"+3d             3D SPH in a tank, drawn as point sprites with an orbiting camera (drag or arrow keys).\n"
+"-adaptive       Fixed step size (Particle::stepSize) (default).\n"
+"+adaptive       Adaptive step size: limited by the CFL condition, the largest force and the viscosity, with +local every 2^rungs steps.\n"
+"-alloccheck #   Warm up for # steps, count the heap allocations of the next # steps, fail if there are any, and quit (COUNT_ALLOCATIONS builds).\n"
 "-benchmark      Run simulation for 3 minutes (~10,800 frames @ 60fps), render first frame at frame number 7,200.\n"
 "-benchfast      Run simulation for 10 seconds (~600 frames @ 60fps), render first frame at frame number 300.\n"
+"-block  #       Particles along each edge of the initial +3d block (Default 20, 8000 particles).\n"
+"-cells  #       Cells per smoothing length for -solver sph, 1 to 3, or 0 to choose from the density (default).\n"
+"-compact        SPH tiles read full precision copies of the particles (default).\n"
+"+compact        SPH tiles read packed particles: 16 bit cell offsets and fp16 velocities and densities.\n"
+"-compactcheck # Step -solver sph for # steps, compare every step's densities and forces with +compact, and quit.\n"
+"-container file Container walls for -solver sph from the loops in an OBJ file, e.g. res/containers/hourglass.obj.\n"
+"-double         Single precision SPH solver (default).\n"
+"+double         Double precision SPH solver, for validating the single precision one.\n"
+"-dt     #.####  Fixed step size in seconds for -adaptive and -solver pbf, largest step for -solver dfsph, flip and apic.\n"
+"-export file    Write the fluid surface polylines to an OBJ file on exit (implies +surface).\n"
+"-fastmath       Exact SPH kernels: sqrt for every neighbor distance (default).\n"
+"+fastmath       Fast SPH kernels for -solver sph: squared distances, approximate rsqrt with a Newton step.\n"
+"-fastcheck #    Step the exact -solver sph for # steps, compare every step's densities and forces with +fastmath, and quit.\n"
+"-flow   file    Nozzles, area sources and drains for -solver sph from a flow file, e.g. res/flows/fountain.flow.\n"
+"-fused          Separate kick pass after the -solver sph forces, the reference for the fused pass.\n"
+"+fused          Kick every particle in the -solver sph force pass, as soon as its forces are done (default).\n"
+"-metrics file   Write per-frame CPU and GPU timings (ms) to a CSV file.\n"
+"-metricscheck # Draw # frames, check that every frame's GPU timer queries were read back in time, and quit.\n"
+"-gpu            CPU SPH solver (default).\n"
+"+gpu            OpenGL 4.3 compute shader SPH solver, rendered straight from its buffer.\n"
+"-gpucheck #     Run the CPU and compute shader solvers side by side for # steps, compare and quit.\n"
+"-iterations #   Density constraint iterations per step of -solver pbf (Default 4).\n"
+"-leapfrog       Symplectic Euler integrator (default): kick, then drift.\n"
+"+leapfrog       Leapfrog (velocity Verlet) integrator: half kick, drift, half kick.\n"
+"-local          Every particle takes the same step (default).\n"
+"+local          Local steps for -solver sph: calm particles get new forces every 2, 4 or 8 steps, see -rungs.\n"
+"-localcheck #   Step -solver sph for # steps, again with +local on rung 0, check they are the same bit for bit, and quit.\n"
+"-levels #       Coarsest +multires level, each level doubles the particle mass (Default 2).\n"
+"-lod            Level of detail off: always draw full discs.\n"
+"+lod            Level of detail on (default): fewer segments, points and cell splats when zoomed out.\n"
+"-multires       Uniform particle resolution (default).\n"
+"+multires       Adaptive resolution for -solver sph: calm interior particles merge, particles at the surface or in vortices split.\n"
+"-obstacles #    Moving circles, boxes and capsules stirring the bottom of the -solver sph box (Default 0).\n"
+"-periodic axes  Axes of the -solver sph box that wrap around instead of having walls: x, y, z or e.g. xz (Default none).\n"
+"-pool   #       Particle slots of the -flow pool, live or dead (Default 4000).\n"
 "-render #       Don't render until specified frame number. -1 is never render. (Default 0).\n"
+"-rungs  #       Deepest +local rung, rung r gets new forces every 2^r steps (Default 3).\n"
+"-shader file    Load the shader from a file instead of the copy embedded at build time.\n"
+"-shadercache    Shader program binary cache off.\n"
+"+shadercache    Shader program binary cache on (default): reuse the linked program from res/shaders/Basic.bin.\n"
+"-solver name    sph: weakly compressible SPH with pressure forces (default).\n"
+"                pbf: Position Based Fluids, density constraints solved with Jacobi iterations, large steps.\n"
+"                dfsph: Divergence-free SPH, incompressible pressure solve, CFL limited steps.\n"
+"                flip: FLIP particle-grid solver, multigrid preconditioned pressure solve on a MAC grid.\n"
+"                apic: Like flip, with APIC transfers: less noise, no numerical damping.\n"
+"-sleep          Every particle is stepped every step (default).\n"
+"+sleep          Sleeping cells for -solver sph: cells that stay quiet for a while are frozen until stirred.\n"
+"-surface        Fluid surface extraction off (default).\n"
+"+surface        Fluid surface extraction on: resample onto a grid and draw the iso-line.\n"
+"-tiles          -solver sph neighbor sums walk each particle's cells, the reference for the tiles.\n"
+"+tiles          -solver sph neighbor sums by cell pairs over copies in the cells' order (default).\n"
 "-time   #.##    Run simulation for specified seconds.\n"
 "-v              Verbose mode off (default).\n"
 "+v              Verbose mode on.\n"
 "-V              Display version and quit.\n"
 "--version       Alias for -V.\n"
+"-viscosity #    Viscosity multiplier of -solver sph (Default 0.0002).\n"
 "-vsync          VSync off.\n"
 "+vsync          VSync on (default).\n"
     ;
@@ -90,6 +248,32 @@ void parseCommandLine(int nArgs, const char* aArgs[])
                 exit(0);
             }
             else
+            if (strcmp(pArg, "-3d") == 0) {
+                Sph3d::enabled = false;
+            }
+            else
+            if (strcmp(pArg, "-adaptive") == 0) {
+                Particle::adaptive = false;
+            }
+            else
+            if (strcmp(pArg, "-alloccheck") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Number of steps to check was not specified.\ni.e.\n    -alloccheck 100\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                allocCheckSteps = atoi( pArg );
+                if (allocCheckSteps < 1)
+                    allocCheckSteps = 1;
+            }
+            else
             if (strcmp(pArg, "-benchmark") == 0) {
                 numFirstRenderFrame   = 2*60 * 60; // 2 min * 60 s/min * 60 frames/s = 7,200 frames
                 numLastPhysicsSeconds = 3.0 * 60.0; // 3 min * 60 s/min = 180 seconds
@@ -102,6 +286,355 @@ void parseCommandLine(int nArgs, const char* aArgs[])
                 benchmark = true;
             }
             else
+            if (strcmp(pArg, "-block") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Block size was not specified.\ni.e.\n    -block 32\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                Sph3d::blockSize = atoi( pArg );
+                if (Sph3d::blockSize < 1)
+                    Sph3d::blockSize = 1;
+            }
+            else
+            if (strcmp(pArg, "-cells") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Cells per smoothing length were not specified.\ni.e.\n    -cells 2\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                Particle::cellDivisions = glm::clamp(atoi( pArg ), 0, 3);
+            }
+            else
+            if (strcmp(pArg, "-compact") == 0) {
+                Particle::compactStorage = false;
+            }
+            else
+            if (strcmp(pArg, "-compactcheck") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Number of steps to check was not specified.\ni.e.\n    -compactcheck 100\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                compactCheckSteps = atoi( pArg );
+                if (compactCheckSteps < 1)
+                    compactCheckSteps = 1;
+            }
+            else
+            if (strcmp(pArg, "-container") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Container file was not specified.\ni.e.\n    -container res/containers/hourglass.obj\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                containerPath = aArgs[ iArg ];
+            }
+            else
+            if (strcmp(pArg, "-fastmath") == 0) {
+                Particle::fastMath = false;
+            }
+            else
+            if (strcmp(pArg, "-fastcheck") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Number of steps to check was not specified.\ni.e.\n    -fastcheck 100\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                fastCheckSteps = atoi( pArg );
+                if (fastCheckSteps < 1)
+                    fastCheckSteps = 1;
+            }
+            else
+            if (strcmp(pArg, "-flow") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Flow file was not specified.\ni.e.\n    -flow res/flows/fountain.flow\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                flowPath = aArgs[ iArg ];
+            }
+            else
+            if (strcmp(pArg, "-fused") == 0) {
+                Particle::fusedForces = false;
+            }
+            else
+            if (strcmp(pArg, "-double") == 0) {
+                Particle::doublePrecision = false;
+            }
+            else
+            if (strcmp(pArg, "-dt") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Step size was not specified.\ni.e.\n    -dt 0.002\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                Particle::stepSize = (float)atof( pArg );
+                if (Particle::stepSize < 1e-6f)
+                    Particle::stepSize = 1e-6f;
+                Pbf::stepSize = Particle::stepSize;
+                Dfsph::stepSize = Particle::stepSize;
+                Flip::stepSize = Particle::stepSize;
+            }
+            else
+            if (strcmp(pArg, "-export") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Surface export file was not specified.\ni.e.\n    -export surface.obj\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                exportPath = aArgs[ iArg ];
+                surface = true;
+            }
+            else
+            if (strcmp(pArg, "-gpu") == 0) {
+                GpuSolver::enabled = false;
+            }
+            else
+            if (strcmp(pArg, "-gpucheck") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Number of steps to check was not specified.\ni.e.\n    -gpucheck 10\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                gpuCheckSteps = atoi( pArg );
+                if (gpuCheckSteps < 1)
+                    gpuCheckSteps = 1;
+                GpuSolver::enabled = true;
+            }
+            else
+            if (strcmp(pArg, "-iterations") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Number of iterations was not specified.\ni.e.\n    -iterations 4\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                Pbf::iterations = atoi( pArg );
+                if (Pbf::iterations < 1)
+                    Pbf::iterations = 1;
+            }
+            else
+            if (strcmp(pArg, "-leapfrog") == 0) {
+                Particle::leapfrog = false;
+            }
+            else
+            if (strcmp(pArg, "-levels") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Number of levels was not specified.\ni.e.\n    -levels 2\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                Multires::maxLevel = atoi( pArg );
+                if (Multires::maxLevel < Multires::minLevel)
+                    Multires::maxLevel = Multires::minLevel;
+                // the solver's cell blocks reach 2^(6 / D) cells at most
+                if (Multires::maxLevel > Multires::minLevel + 6)
+                    Multires::maxLevel = Multires::minLevel + 6;
+            }
+            else
+            if (strcmp(pArg, "-local") == 0) {
+                Particle::localSteps = false;
+            }
+            else
+            if (strcmp(pArg, "-localcheck") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Number of steps to check was not specified.\ni.e.\n    -localcheck 300\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                localCheckSteps = atoi( pArg );
+                if (localCheckSteps < 1)
+                    localCheckSteps = 1;
+            }
+            else
+            if (strcmp(pArg, "-lod") == 0) {
+                Camera::lod = false;
+            }
+            else
+            if (strcmp(pArg, "-multires") == 0) {
+                Multires::enabled = false;
+            }
+            else
+            if (strcmp(pArg, "-sleep") == 0) {
+                Sleep::enabled = false;
+            }
+            else
+            if (strcmp(pArg, "-metrics") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Metrics file was not specified.\ni.e.\n    -metrics frames.csv\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                metricsPath = aArgs[ iArg ];
+            }
+            else
+            if (strcmp(pArg, "-metricscheck") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Number of frames to check was not specified.\ni.e.\n    -metricscheck 60\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                metricsCheckFrames = atoi( pArg );
+                if (metricsCheckFrames < 1)
+                    metricsCheckFrames = 1;
+            }
+            else
+            if (strcmp(pArg, "-obstacles") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Number of obstacles was not specified.\ni.e.\n    -obstacles 60\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                Obstacles::count = atoi( pArg );
+                if (Obstacles::count < 0)
+                    Obstacles::count = 0;
+                Obstacles::enabled = Obstacles::count > 0;
+            }
+            else
+            if (strcmp(pArg, "-periodic") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Periodic axes were not specified.\ni.e.\n    -periodic x\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                Particle::periodic = 0;
+                if (strcmp(pArg, "none") != 0) {
+                    for (const char *axis = pArg; *axis; axis++) {
+                        if (*axis < 'x' || *axis > 'z') {
+                            const char *ERROR = "ERROR: Unknown periodic axis, use x, y and z.\ni.e.\n    -periodic x\n";
+#if USE_CPP_IOSTREAM
+                            std::cout << ERROR;
+#else
+                            printf( ERROR );
+#endif
+                            exit(1);
+                        }
+                        Particle::periodic |= 1 << (*axis - 'x');
+                    }
+                }
+            }
+            else
+            if (strcmp(pArg, "-pool") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Number of particle slots was not specified.\ni.e.\n    -pool 4000\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                Emitters::capacity = atoi( pArg );
+                if (Emitters::capacity < 1)
+                    Emitters::capacity = 1;
+            }
+            else
             if (strcmp(pArg, "-render") == 0) {
                 iArg++;
                 if (iArg >= nArgs) {
@@ -120,6 +653,80 @@ void parseCommandLine(int nArgs, const char* aArgs[])
                     numFirstRenderFrame = INT_MAX;
             }
             else
+            if (strcmp(pArg, "-rungs") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Number of rungs was not specified.\ni.e.\n    -rungs 3\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                Particle::maxRung = atoi( pArg );
+                if (Particle::maxRung < 0)
+                    Particle::maxRung = 0;
+                // a 2^rung step stays in the range of the step counter
+                if (Particle::maxRung > 16)
+                    Particle::maxRung = 16;
+            }
+            else
+            if (strcmp(pArg, "-shader") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Shader file was not specified.\ni.e.\n    -shader res/shaders/Basic.shader\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                shaderPath = aArgs[ iArg ];
+            }
+            else
+            if (strcmp(pArg, "-shadercache") == 0) {
+                shaderCache = false;
+            }
+            else
+            if (strcmp(pArg, "-solver") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Solver was not specified.\ni.e.\n    -solver pbf\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                int solver = -1;
+                for (int i = 0; i < Particle::SOLVERS; i++)
+                    if (strcmp(pArg, Particle::solverNames[i]) == 0) solver = i;
+                if (solver < 0) {
+#if USE_CPP_IOSTREAM
+                    std::cout << "ERROR: Unknown solver: " << pArg << std::endl;
+#else
+                    printf( "ERROR: Unknown solver: %s\n", pArg );
+#endif
+                    exit(1);
+                }
+                Particle::solver = solver;
+            }
+            else
+            if (strcmp(pArg, "-surface") == 0) {
+                surface = false;
+            }
+            else
+            if (strcmp(pArg, "-tiles") == 0) {
+                Particle::cellTiles = false;
+            }
+            else
             if (strcmp(pArg, "-time") == 0) {
                 iArg++;
                 if (iArg >= nArgs) {
@@ -147,6 +754,24 @@ void parseCommandLine(int nArgs, const char* aArgs[])
                 exit(0);
             }
             else
+            if (strcmp(pArg, "-viscosity") == 0) {
+                iArg++;
+                if (iArg >= nArgs) {
+                    const char *ERROR = "ERROR: Viscosity was not specified.\ni.e.\n    -viscosity 0.00005\n";
+#if USE_CPP_IOSTREAM
+                    std::cout << ERROR;
+#else
+                    printf( ERROR );
+#endif
+                    exit(1);
+                }
+                pArg = aArgs[ iArg ];
+
+                Particle::viscosityMultiplier = (float)atof( pArg );
+                if (Particle::viscosityMultiplier < 0.0f)
+                    Particle::viscosityMultiplier = 0.0f;
+            }
+            else
             if (strcmp(pArg, "-vsync") == 0) {
                 vsync = false;
             }
@@ -158,6 +783,66 @@ void parseCommandLine(int nArgs, const char* aArgs[])
         else
         if (pArg[0] == '+')
         {
+            if (strcmp(pArg, "+3d") == 0) {
+                Sph3d::enabled = true;
+            }
+            else
+            if (strcmp(pArg, "+adaptive") == 0) {
+                Particle::adaptive = true;
+            }
+            else
+            if (strcmp(pArg, "+compact") == 0) {
+                Particle::compactStorage = true;
+            }
+            else
+            if (strcmp(pArg, "+double") == 0) {
+                Particle::doublePrecision = true;
+            }
+            else
+            if (strcmp(pArg, "+fastmath") == 0) {
+                Particle::fastMath = true;
+            }
+            else
+            if (strcmp(pArg, "+fused") == 0) {
+                Particle::fusedForces = true;
+            }
+            else
+            if (strcmp(pArg, "+gpu") == 0) {
+                GpuSolver::enabled = true;
+            }
+            else
+            if (strcmp(pArg, "+leapfrog") == 0) {
+                Particle::leapfrog = true;
+            }
+            else
+            if (strcmp(pArg, "+multires") == 0) {
+                Multires::enabled = true;
+            }
+            else
+            if (strcmp(pArg, "+local") == 0) {
+                Particle::localSteps = true;
+            }
+            else
+            if (strcmp(pArg, "+lod") == 0) {
+                Camera::lod = true;
+            }
+            else
+            if (strcmp(pArg, "+shadercache") == 0) {
+                shaderCache = true;
+            }
+            else
+            if (strcmp(pArg, "+sleep") == 0) {
+                Sleep::enabled = true;
+            }
+            else
+            if (strcmp(pArg, "+surface") == 0) {
+                surface = true;
+            }
+            else
+            if (strcmp(pArg, "+tiles") == 0) {
+                Particle::cellTiles = true;
+            }
+            else
             if (strcmp(pArg, "+v") == 0) {
                 verbose = true;
             }
@@ -171,12 +856,268 @@ void parseCommandLine(int nArgs, const char* aArgs[])
     }
 }
 
+void stepPhysics()
+{
+    // the temporary buffers of the last step are done with
+    Arena::resetAll();
+    // the 2D cell map follows s_Radius; the SPH solver files it itself, see SphSolver::fileCells
+    bool sph = !GpuSolver::enabled && Particle::solver == Particle::SOLVER_SPH;
+    if (!Sph3d::enabled && !sph && Particle::cells.cellSize != Particle::s_Radius)
+        Particle::rebuildCells();
+    if (Sph3d::enabled)
+        Sph3d::step();
+    else if (GpuSolver::enabled)
+        GpuSolver::step();
+    else if (Particle::solver == Particle::SOLVER_PBF)
+        Pbf::step();
+    else if (Particle::solver == Particle::SOLVER_DFSPH)
+        Dfsph::step();
+    else if (Particle::solver == Particle::SOLVER_FLIP || Particle::solver == Particle::SOLVER_APIC)
+        Flip::step();
+    else
+        Particle::step();
+}
+
+// Steps until every buffer has grown to what the scene needs, then counts the heap allocations
+// of as many steps again. A steady-state step takes its temporaries from the arenas and
+// allocates nothing.
+bool checkAllocations(int numSteps)
+{
+    for (int i = 0; i < numSteps; i++)
+        stepPhysics();
+    long long before = Arena::allocations();
+    for (int i = 0; i < numSteps; i++)
+        stepPhysics();
+    long long allocations = Arena::allocations() - before;
+    bool passed = allocations == 0;
+#if USE_CPP_IOSTREAM
+    std::cout << "Allocation check: " << allocations << " heap allocations in " << numSteps
+              << " steps after " << numSteps << " warmup steps, " << (passed ? "PASSED" : "FAILED") << std::endl;
+#else
+    printf( "Allocation check: %lld heap allocations in %d steps after %d warmup steps, %s\n",
+        allocations, numSteps, numSteps, passed ? "PASSED" : "FAILED" );
+#endif
+    return passed;
+}
+
+// The SPH solver of the chosen dimension and precision with the mode off, against it on, see SphSolver::validate
+bool checkApproximation(int numSteps, bool& mode, const char *name, double tolerance, double outliers)
+{
+    if (Sph3d::enabled)
+        return Particle::doublePrecision ? SphSolver<3, double>::validate(numSteps, mode, name, tolerance, outliers)
+                                         : SphSolver<3, float>::validate(numSteps, mode, name, tolerance, outliers);
+    return Particle::doublePrecision ? SphSolver<2, double>::validate(numSteps, mode, name, tolerance, outliers)
+                                     : SphSolver<2, float>::validate(numSteps, mode, name, tolerance, outliers);
+}
+
+// The SPH solver of the chosen dimension and precision with the mode off, then on, see SphSolver::compare
+bool checkSteps(int numSteps, bool& mode, const char *name)
+{
+    if (Sph3d::enabled)
+        return Particle::doublePrecision ? SphSolver<3, double>::compare(numSteps, mode, name)
+                                         : SphSolver<3, float>::compare(numSteps, mode, name);
+    return Particle::doublePrecision ? SphSolver<2, double>::compare(numSteps, mode, name)
+                                     : SphSolver<2, float>::compare(numSteps, mode, name);
+}
+
+// Particle::particles as the SPH solver of the chosen dimension and precision left them, see SphSolver::store
+void storeSph()
+{
+    if (Sph3d::enabled) {
+        if (Particle::doublePrecision) SphSolver<3, double>::store();
+        else SphSolver<3, float>::store();
+    }
+    else if (Particle::doublePrecision) SphSolver<2, double>::store();
+    else SphSolver<2, float>::store();
+}
+
+// The neighbor cells of the SPH solver of the chosen dimension and precision, see SphSolver::countPairs
+int countNeighborPairs(double& density, long long& candidates, long long& neighbors)
+{
+    if (Sph3d::enabled)
+        return Particle::doublePrecision ? SphSolver<3, double>::countPairs(density, candidates, neighbors)
+                                         : SphSolver<3, float>::countPairs(density, candidates, neighbors);
+    return Particle::doublePrecision ? SphSolver<2, double>::countPairs(density, candidates, neighbors)
+                                     : SphSolver<2, float>::countPairs(density, candidates, neighbors);
+}
+
 int main(int numArgs, const char *aArgs[])
 {
     parseCommandLine( numArgs, aArgs );
 
-    Window window(1600, 1000, vsync);
-    
+    if (Sph3d::enabled) {
+        // the other solvers, the compute shaders and the surface are all 2D
+        const char *WARNING = nullptr;
+        if (GpuSolver::enabled || Particle::solver != Particle::SOLVER_SPH || surface)
+            WARNING = "WARNING: +3d runs the CPU SPH solver only, +gpu, -solver and +surface ignored.\n";
+        if (WARNING) {
+#if USE_CPP_IOSTREAM
+            std::cout << WARNING;
+#else
+            printf( WARNING );
+#endif
+        }
+        GpuSolver::enabled = false;
+        Particle::solver = Particle::SOLVER_SPH;
+        surface = false;
+        exportPath = nullptr;
+    }
+
+    if (Multires::enabled && (GpuSolver::enabled || Particle::solver != Particle::SOLVER_SPH)) {
+        // the other solvers keep one particle size
+        const char *WARNING = "WARNING: +multires needs the CPU SPH solver, disabled.\n";
+#if USE_CPP_IOSTREAM
+        std::cout << WARNING;
+#else
+        printf( WARNING );
+#endif
+        Multires::enabled = false;
+    }
+
+    if (containerPath && (Sph3d::enabled || GpuSolver::enabled || Particle::solver != Particle::SOLVER_SPH)) {
+        // the other solvers and the 3D tank keep the box
+        const char *WARNING = "WARNING: -container needs the 2D CPU SPH solver, ignored.\n";
+#if USE_CPP_IOSTREAM
+        std::cout << WARNING;
+#else
+        printf( WARNING );
+#endif
+        containerPath = nullptr;
+    }
+    if (containerPath && !Container::load(containerPath)) {
+        const char *ERROR = "ERROR: Could not read the container loops.\n";
+#if USE_CPP_IOSTREAM
+        std::cout << ERROR;
+#else
+        printf( ERROR );
+#endif
+        exit(1);
+    }
+
+    if (Obstacles::enabled && (Sph3d::enabled || GpuSolver::enabled || Particle::solver != Particle::SOLVER_SPH)) {
+        const char *WARNING = "WARNING: -obstacles needs the 2D CPU SPH solver, ignored.\n";
+#if USE_CPP_IOSTREAM
+        std::cout << WARNING;
+#else
+        printf( WARNING );
+#endif
+        Obstacles::enabled = false;
+        Obstacles::count = 0;
+    }
+
+    if (flowPath && (Sph3d::enabled || GpuSolver::enabled || Particle::solver != Particle::SOLVER_SPH)) {
+        const char *WARNING = "WARNING: -flow needs the 2D CPU SPH solver, ignored.\n";
+#if USE_CPP_IOSTREAM
+        std::cout << WARNING;
+#else
+        printf( WARNING );
+#endif
+        flowPath = nullptr;
+    }
+    if (allocCheckSteps > 0 && !Arena::counting) {
+        // 77 tells scripts/check.cmake the check was skipped rather than failed
+        const char *ERROR = "ERROR: -alloccheck needs a build with COUNT_ALLOCATIONS defined, see Arena.h.\n";
+#if USE_CPP_IOSTREAM
+        std::cout << ERROR;
+#else
+        printf( ERROR );
+#endif
+        exit(77);
+    }
+    if (flowPath && !Emitters::load(flowPath)) {
+        const char *ERROR = "ERROR: Could not read the nozzles, sources and drains of the flow file.\n";
+#if USE_CPP_IOSTREAM
+        std::cout << ERROR;
+#else
+        printf( ERROR );
+#endif
+        exit(1);
+    }
+
+    if (Particle::periodic && (Container::enabled || GpuSolver::enabled || Particle::solver != Particle::SOLVER_SPH)) {
+        // the container's loops are closed walls
+        const char *WARNING = "WARNING: -periodic needs the CPU SPH solver in its box, ignored.\n";
+#if USE_CPP_IOSTREAM
+        std::cout << WARNING;
+#else
+        printf( WARNING );
+#endif
+        Particle::periodic = 0;
+    }
+    // the 2D box has no z axis
+    if (!Sph3d::enabled)
+        Particle::periodic &= 3;
+
+    if (Sph3d::enabled && Sph3d::blockSize > Sph3d::maxBlock()) {
+        const char *WARNING = "WARNING: -block does not fit in the tank, clamped to the largest block that does.\n";
+#if USE_CPP_IOSTREAM
+        std::cout << WARNING;
+#else
+        printf( WARNING );
+#endif
+        Sph3d::blockSize = Sph3d::maxBlock();
+    }
+
+    if ((Particle::localSteps || localCheckSteps > 0) && (GpuSolver::enabled || Particle::solver != Particle::SOLVER_SPH)) {
+        const char *WARNING = "WARNING: +local and -localcheck need the CPU SPH solver, disabled.\n";
+#if USE_CPP_IOSTREAM
+        std::cout << WARNING;
+#else
+        printf( WARNING );
+#endif
+        Particle::localSteps = false;
+        localCheckSteps = 0;
+    }
+
+    if ((Particle::fastMath || fastCheckSteps > 0) && (GpuSolver::enabled || Particle::solver != Particle::SOLVER_SPH)) {
+        const char *WARNING = "WARNING: +fastmath and -fastcheck need the CPU SPH solver, disabled.\n";
+#if USE_CPP_IOSTREAM
+        std::cout << WARNING;
+#else
+        printf( WARNING );
+#endif
+        Particle::fastMath = false;
+        fastCheckSteps = 0;
+    }
+
+    if ((Particle::compactStorage || compactCheckSteps > 0) && (GpuSolver::enabled || Particle::solver != Particle::SOLVER_SPH || !Particle::cellTiles)) {
+        // the packed particles are what the tiles copy, the per-particle walk reads the states
+        const char *WARNING = "WARNING: +compact and -compactcheck need the CPU SPH solver with +tiles, disabled.\n";
+#if USE_CPP_IOSTREAM
+        std::cout << WARNING;
+#else
+        printf( WARNING );
+#endif
+        Particle::compactStorage = false;
+        compactCheckSteps = 0;
+    }
+
+    if (Particle::cellDivisions > 0 && Multires::enabled) {
+        // the Multires cells follow the smallest smoothing length instead
+        const char *WARNING = "WARNING: -cells does not apply to +multires, ignored.\n";
+#if USE_CPP_IOSTREAM
+        std::cout << WARNING;
+#else
+        printf( WARNING );
+#endif
+        Particle::cellDivisions = 0;
+    }
+
+    if (Sleep::enabled && (GpuSolver::enabled || Particle::solver != Particle::SOLVER_SPH)) {
+        const char *WARNING = "WARNING: +sleep needs the CPU SPH solver, disabled.\n";
+#if USE_CPP_IOSTREAM
+        std::cout << WARNING;
+#else
+        printf( WARNING );
+#endif
+        Sleep::enabled = false;
+    }
+
+    // compute shaders need a 4.3 context, the check modes quit before the first frame and stay hidden
+    bool checking = gpuCheckSteps > 0 || allocCheckSteps > 0 || fastCheckSteps > 0 || compactCheckSteps > 0 || localCheckSteps > 0 || metricsCheckFrames > 0;
+    Window window(1600, 1000, vsync, GpuSolver::enabled ? 4 : 0, GpuSolver::enabled ? 3 : 0, !checking);
+    Metrics::startupPhase("window");
+
     // Generating Buffers
     glGenVertexArrays(1, &Window::vao);
     glGenBuffers(1, &Window::vbo);
@@ -184,14 +1125,45 @@ int main(int numArgs, const char *aArgs[])
     glGenVertexArrays(1, &Particle::vao);
     glGenBuffers(1, &Particle::vbo);
     glGenBuffers(1, &Particle::ibo);
+    glGenBuffers(1, &Particle::instanceVbo);
+
+    glGenVertexArrays(1, &Obstacles::vao);
+    glGenBuffers(1, &Obstacles::vbo);
 
-    Particle::generateGridCenters(20, 25); // generate grid / random particles
-    Particle::populate(window.aspectRatio); // create particles using center positions
+    glGenVertexArrays(1, &Emitters::vao);
+    glGenBuffers(1, &Emitters::vbo);
+
+    glGenVertexArrays(1, &Surface::vao);
+    glGenBuffers(1, &Surface::vbo);
+
+    Metrics::startupPhase("buffers");
+
+    if (Sph3d::enabled)
+        Sph3d::populate();
+    else {
+        Particle::generateGridCenters(20, 25); // generate grid / random particles
+        if (Container::enabled) {
+            Container::bake();
+            Container::keepInside(Particle::centers, Particle::radius);
+        }
+        if (Obstacles::enabled) Obstacles::generate();
+        Particle::populate(window.aspectRatio); // create particles using center positions
+        if (Emitters::enabled) {
+            // the whole pool up front, the solver reserves its own when it loads
+            Emitters::capacity = std::max(Emitters::capacity, (int)Particle::particles.size());
+            Particle::particles.reserve(Emitters::capacity);
+            Particle::cells.filed.reserve(Emitters::capacity);
+        }
+    }
+    Metrics::startupPhase("scene");
 
-    // creating and compiling shaders
-    Shader::shaderProgramSource source = Shader::parse("res/shaders/Basic.shader");
-    unsigned int shader = Shader::create(source.vertexSource, source.fragmentSource);
+    // creating and compiling shaders, or reusing the program linked by an earlier run
+    Shader::shaderProgramSource source = shaderPath ? Shader::parse(shaderPath) : Shader::split(Shader::basicSource);
+    unsigned int shader = shaderCache
+        ? Shader::load(source, "res/shaders/Basic.bin")
+        : Shader::create(source.vertexSource, source.fragmentSource);
     glUseProgram(shader);
+    Metrics::startupPhase(Shader::cacheHit ? "shader (cached)" : "shader");
 
     // Uniforms Declaration
     int color_Location = glGetUniformLocation(shader, "u_Color");
@@ -200,11 +1172,101 @@ int main(int numArgs, const char *aArgs[])
     int object_Location = glGetUniformLocation(shader, "u_pos");
     glUniform4f(object_Location, 0.0f, 0.0f, 0.0f, 0.0f);
 
+    int view_Location = glGetUniformLocation(shader, "u_View");
+    Camera::attach(window.win, window.width, window.height);
+
+    if (Sph3d::enabled && !Sph3d::initRenderer()) {
+        const char *ERROR = "ERROR: Could not create the point sprite shader.\n";
+#if USE_CPP_IOSTREAM
+        std::cout << ERROR;
+#else
+        printf( ERROR );
+#endif
+        exit(1);
+    }
+
+    if (GpuSolver::enabled) {
+        if (!GpuSolver::init()) {
+            const char *ERROR = "ERROR: OpenGL 4.3 compute shaders are not available.\n";
+#if USE_CPP_IOSTREAM
+            std::cout << ERROR;
+#else
+            printf( ERROR );
+#endif
+            exit(1);
+        }
+        if (Particle::solver != Particle::SOLVER_SPH) {
+            const char *WARNING = "WARNING: +gpu runs the SPH solver only, -solver ignored.\n";
+#if USE_CPP_IOSTREAM
+            std::cout << WARNING;
+#else
+            printf( WARNING );
+#endif
+            Particle::solver = Particle::SOLVER_SPH;
+        }
+        // the compute passes take fixed symplectic Euler steps, the CPU solver has to match them for -gpucheck
+        Particle::adaptive = false;
+        Particle::leapfrog = false;
+        if (gpuCheckSteps > 0) {
+            bool passed = GpuSolver::validate(gpuCheckSteps);
+            glfwTerminate();
+            return passed ? 0 : 1;
+        }
+        if (surface) {
+            // the surface pass reads the CPU particles, which the GPU solver never touches
+            const char *WARNING = "WARNING: +surface is not available with +gpu, disabled.\n";
+#if USE_CPP_IOSTREAM
+            std::cout << WARNING;
+#else
+            printf( WARNING );
+#endif
+            surface = false;
+            exportPath = nullptr;
+        }
+    }
+
+    if (fastCheckSteps > 0) {
+        bool passed = checkApproximation(fastCheckSteps, Particle::fastMath, "Fast math", 1e-4, 0.0);
+        glfwTerminate();
+        return passed ? 0 : 1;
+    }
+
+    if (compactCheckSteps > 0) {
+        bool passed = checkApproximation(compactCheckSteps, Particle::compactStorage, "Compact storage", 1e-2, 1e-3);
+        glfwTerminate();
+        return passed ? 0 : 1;
+    }
+
+    if (localCheckSteps > 0) {
+        // on rung 0 every particle is due every step, its kicks have to add up to the global step's
+        Particle::maxRung = 0;
+        bool passed = checkSteps(localCheckSteps, Particle::localSteps, "Local steps");
+        glfwTerminate();
+        return passed ? 0 : 1;
+    }
+
+    if (allocCheckSteps > 0) {
+        bool passed = checkAllocations(allocCheckSteps);
+        glfwTerminate();
+        return passed ? 0 : 1;
+    }
+
+    Metrics::init();
+    if (metricsPath && !Metrics::open(metricsPath)) {
+#if USE_CPP_IOSTREAM
+        std::cout << "ERROR: Could not write metrics to " << metricsPath << std::endl;
+#else
+        printf( "ERROR: Could not write metrics to %s\n", metricsPath );
+#endif
+    }
+
     /* Loop until the user closes the window */
 
     static double lastTime              = 0.0f;
     static double elapsed               = 0.0;
     static int    numFrame              = 0;
+    static double physicsSeconds        = 0.0;
+    static double particleSteps         = 0.0; // particles times steps
 
 #if USE_CPP_IOSTREAM
     std::cout.precision(6);
@@ -221,12 +1283,57 @@ int main(int numArgs, const char *aArgs[])
 
     while (!glfwWindowShouldClose(window.win))
     {
-        /* Render here */
-        glClear(GL_COLOR_BUFFER_BIT);
+        Metrics::beginFrame(numFrame);
 
-        Window::drawBoundary(object_Location, color_Location);
+        /* Render here */
         bool bDraw = (numFrame >= numFirstRenderFrame);
-        Particle::drawElements(window, object_Location, color_Location, bDraw);
+        if (Sph3d::enabled) {
+            // the tank is drawn with the particles
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            if (bDraw) {
+                Metrics::beginGpu(Metrics::GPU_PARTICLES);
+                Sph3d::drawElements();
+                Metrics::endGpu(Metrics::GPU_PARTICLES);
+            }
+        }
+        else {
+            glClear(GL_COLOR_BUFFER_BIT);
+            Camera::setUniform(view_Location);
+
+            Metrics::beginGpu(Metrics::GPU_BOUNDARY);
+            Window::drawBoundary(object_Location, color_Location);
+            if (Obstacles::enabled) Obstacles::drawElements(object_Location, color_Location);
+            if (Emitters::enabled) Emitters::drawElements(object_Location, color_Location);
+            Metrics::endGpu(Metrics::GPU_BOUNDARY);
+
+            if (bDraw) {
+                Metrics::beginGpu(Metrics::GPU_PARTICLES);
+                if (GpuSolver::enabled)
+                    GpuSolver::drawElements(object_Location, color_Location);
+                else
+                    Particle::drawElements(object_Location, color_Location);
+                Metrics::endGpu(Metrics::GPU_PARTICLES);
+            }
+        }
+
+        Metrics::beginCpu(Metrics::CPU_PHYSICS);
+        stepPhysics();
+        Metrics::endCpu(Metrics::CPU_PHYSICS);
+        physicsSeconds += Metrics::cpuMs[Metrics::CPU_PHYSICS] / 1000.0;
+        particleSteps += (double)Emitters::liveCount();
+
+        if (surface) {
+            Metrics::beginCpu(Metrics::CPU_SURFACE);
+            Surface::resample();
+            Surface::extract();
+            Metrics::endCpu(Metrics::CPU_SURFACE);
+            if (bDraw) {
+                Metrics::beginGpu(Metrics::GPU_SURFACE);
+                Surface::drawElements(object_Location, color_Location);
+                Metrics::endGpu(Metrics::GPU_SURFACE);
+            }
+        }
+        Metrics::endFrame();
 
         //calculate fps
         numFrame++;
@@ -242,18 +1349,62 @@ int main(int numArgs, const char *aArgs[])
                 << " / Frametime: " << std::setw(7) << std::setprecision(3) << deltaTime * 1000.f << "ms"
                 << "  Frame #: "    << std::setw(7)                         << numFrame
                 << "  Elapsed: "    << std::setw(7) << std::setprecision(3) << elapsed << " s"
-                << std::endl;
+                << "  Simulated: "  << std::setw(7) << std::setprecision(3) << Particle::simulatedTime << " s"
+                << "  dt: "         << std::setw(7) << std::setprecision(3) << Particle::dt * 1000.f << " ms (" << Particle::dtLimit << ")"
+                << "  Drawn: "      << std::setw(7)                         << Particle::numVisible
+                << " ("             <<                                         Particle::numSplats << " splats)";
+            if (Particle::solver == Particle::SOLVER_PBF)
+                std::cout
+                << "  Compression: " << std::setw(6) << std::setprecision(3) << Pbf::densityError * 100.f << "%";
+            if (Particle::solver == Particle::SOLVER_DFSPH)
+                std::cout
+                << "  Iterations: "  << std::setw(3) << Dfsph::densityIterations << " density ("    << std::setprecision(3) << Dfsph::densityError * 100.f << "%)"
+                << " / "             << std::setw(3) << Dfsph::divergenceIterations << " divergence (" << std::setprecision(3) << Dfsph::divergenceError * 100.f << "%)";
+            if (Particle::solver == Particle::SOLVER_FLIP || Particle::solver == Particle::SOLVER_APIC)
+                std::cout
+                << "  CG: "          << std::setw(3) << Flip::iterations << " iterations (" << std::setprecision(3) << Flip::residual * 100.f << "%)";
+            if (Sleep::enabled || Particle::localSteps)
+                std::cout
+                << "  Active: "     << std::setw(6) << std::setprecision(3) << Metrics::activeFraction * 100.0 << "%";
+            if (surface)
+                std::cout
+                << "  Surface: "    << Surface::polyStarts.size() << " lines / " << Surface::vertices.size() / 2 << " verts";
+            std::cout << std::endl;
 #else
-            printf( "FPS: %7.3f / Frametime: %7.3f ms  Frame #: %7d  Elapsed: %7.3f s\n", (1.f / deltaTime), deltaTime * 1000.f, numFrame, elapsed );
+            printf( "FPS: %7.3f / Frametime: %7.3f ms  Frame #: %7d  Elapsed: %7.3f s  Simulated: %7.3f s  dt: %7.3f ms (%s)  Drawn: %7d (%d splats)", (1.f / deltaTime), deltaTime * 1000.f, numFrame, elapsed, Particle::simulatedTime, Particle::dt * 1000.f, Particle::dtLimit, Particle::numVisible, Particle::numSplats );
+            if (Particle::solver == Particle::SOLVER_PBF)
+                printf( "  Compression: %6.3f%%", Pbf::densityError * 100.f );
+            if (Particle::solver == Particle::SOLVER_DFSPH)
+                printf( "  Iterations: %3d density (%.3f%%) / %3d divergence (%.3f%%)", Dfsph::densityIterations, Dfsph::densityError * 100.f, Dfsph::divergenceIterations, Dfsph::divergenceError * 100.f );
+            if (Particle::solver == Particle::SOLVER_FLIP || Particle::solver == Particle::SOLVER_APIC)
+                printf( "  CG: %3d iterations (%.3f%%)", Flip::iterations, Flip::residual * 100.f );
+            if (Sleep::enabled || Particle::localSteps)
+                printf( "  Active: %6.2f%%", Metrics::activeFraction * 100.0 );
+            if (surface)
+                printf( "  Surface: %d lines / %d verts", (int)Surface::polyStarts.size(), (int)Surface::vertices.size() / 2 );
+            printf( "\n" );
 #endif
         }
 
         /* Swap front and back buffers */
+        Metrics::beginCpu(Metrics::CPU_SWAP);
         glfwSwapBuffers(window.win);
+        Metrics::endCpu(Metrics::CPU_SWAP);
+        if (numFrame == 1) Metrics::startupPhase("first frame");
+        if (verbose) Metrics::print();
 
         /* Poll for and process events */
         glfwPollEvents();
         if (numLastPhysicsSeconds > 0.0 && (elapsed >= numLastPhysicsSeconds)) break;
+        if (metricsCheckFrames > 0 && numFrame >= metricsCheckFrames) break;
+    }
+
+    Metrics::finish();
+    if (metricsCheckFrames > 0) {
+        bool passed = Metrics::validate(metricsCheckFrames);
+        glDeleteProgram(shader);
+        glfwTerminate();
+        return passed ? 0 : 1;
     }
 
     double frames  = (double)numFrame; // frames
@@ -270,6 +1421,171 @@ int main(int numArgs, const char *aArgs[])
     printf( "Total Frames: %d / Total Elapsed: %7.3f s = Avg FPS: %7.3f, Avg Frametime: %7.3f ms \n", numFrame, elapsed , avgFPS, avgFTms );
 #endif
 
+    double avgDt = Particle::simulatedTime / (double)std::max(Particle::numSteps, 1);
+    double simRate = Particle::simulatedTime / std::max(elapsed, 1e-9);
+    char method[64];
+    if (Particle::solver == Particle::SOLVER_PBF)
+        snprintf( method, sizeof(method), "pbf: %d iterations", Pbf::iterations );
+    else if (Particle::solver == Particle::SOLVER_DFSPH)
+        snprintf( method, sizeof(method), "dfsph: avg %.1f density / %.1f divergence iterations",
+            (double)Dfsph::totalDensityIterations / std::max(Particle::numSteps, 1), (double)Dfsph::totalDivergenceIterations / std::max(Particle::numSteps, 1) );
+    else if (Particle::solver == Particle::SOLVER_FLIP || Particle::solver == Particle::SOLVER_APIC)
+        snprintf( method, sizeof(method), "%s: %dx%d grid, avg %.1f CG iterations", Particle::solverNames[Particle::solver],
+            Flip::resolution, Flip::resolution, (double)Flip::totalIterations / std::max(Particle::numSteps, 1) );
+    else
+        snprintf( method, sizeof(method), "%s: %s, %s, %s", Sph3d::enabled ? "sph 3d" : "sph", Particle::adaptive ? "adaptive" : "fixed",
+            Particle::leapfrog ? "leapfrog" : "symplectic Euler", Particle::doublePrecision ? "double" : "float" );
+    if (Multires::enabled && Particle::solver == Particle::SOLVER_SPH)
+        strncat( method, ", multires", sizeof(method) - strlen(method) - 1 );
+    if (Container::enabled)
+        strncat( method, ", container", sizeof(method) - strlen(method) - 1 );
+    if (Emitters::enabled)
+        strncat( method, ", flow", sizeof(method) - strlen(method) - 1 );
+    if (Particle::localSteps && Particle::solver == Particle::SOLVER_SPH)
+        strncat( method, ", local", sizeof(method) - strlen(method) - 1 );
+    else if (!Particle::fusedForces && Particle::solver == Particle::SOLVER_SPH)
+        strncat( method, ", split kick", sizeof(method) - strlen(method) - 1 );
+    if (!Particle::cellTiles && Particle::solver == Particle::SOLVER_SPH)
+        strncat( method, ", no tiles", sizeof(method) - strlen(method) - 1 );
+    if (Particle::fastMath)
+        strncat( method, ", fast math", sizeof(method) - strlen(method) - 1 );
+    if (Particle::compactStorage)
+        strncat( method, ", compact", sizeof(method) - strlen(method) - 1 );
+    if (Particle::periodic)
+        strncat( method, ", periodic", sizeof(method) - strlen(method) - 1 );
+    if (Sleep::enabled)
+        strncat( method, ", sleep", sizeof(method) - strlen(method) - 1 );
+#if USE_CPP_IOSTREAM
+    std::cout
+        <<   "Simulated Time: " << std::setw(7) << std::setprecision(3) << Particle::simulatedTime << " s "
+        << "in "               <<                                         Particle::numSteps << " steps"
+        << ", Avg dt: "        << std::setw(7) << std::setprecision(4) << avgDt * 1000.0 << " ms"
+        << " (" << method << ")"
+        << " = "               << std::setw(7) << std::setprecision(3) << simRate << " simulated s per s"
+        << std::endl;
+#else
+    printf( "Simulated Time: %7.3f s in %d steps, Avg dt: %7.4f ms (%s) = %7.3f simulated s per s\n", Particle::simulatedTime, Particle::numSteps, avgDt * 1000.0, method, simRate );
+#endif
+
+    // particles advanced one step per second of physics time, comparable across the 2D and 3D modes
+    double throughput = particleSteps / std::max(physicsSeconds, 1e-9);
+#if USE_CPP_IOSTREAM
+    std::cout
+        <<   "Throughput: "    <<                                         Emitters::liveCount() << " particles (" << (Sph3d::enabled ? "3D" : "2D") << ")"
+        << ", Physics: "       << std::setw(7) << std::setprecision(3) << physicsSeconds << " s"
+        << " = "               << std::setw(7) << std::setprecision(3) << throughput / 1e6 << " M particle steps per s"
+        << std::endl;
+#else
+    printf( "Throughput: %d particles (%s), Physics: %7.3f s = %7.3f M particle steps per s\n", Emitters::liveCount(), Sph3d::enabled ? "3D" : "2D", physicsSeconds, throughput / 1e6 );
+#endif
+
+    if (Particle::solver == Particle::SOLVER_SPH && !GpuSolver::enabled && !Multires::enabled) {
+        // the distances the neighbor loops compute over the last sort, and how many of them come within h
+        double density;
+        long long candidates, neighbors;
+        int divisions = countNeighborPairs(density, candidates, neighbors);
+        double within = 100.0 * (double)neighbors / (double)std::max(candidates, 1LL);
+#if USE_CPP_IOSTREAM
+        std::cout << "Neighbor cells: h/" << divisions << " at " << std::setprecision(1) << density << " particles per h^" << (Sph3d::enabled ? 3 : 2)
+                  << ", " << std::setprecision(0) << within << "% of " << candidates << " candidate pairs within h" << std::endl;
+#else
+        printf( "Neighbor cells: h/%d at %.1f particles per h^%d, %.0f%% of %lld candidate pairs within h\n",
+            divisions, density, Sph3d::enabled ? 3 : 2, within, candidates );
+#endif
+    }
+
+    if (Particle::compactStorage) {
+        // what the force tiles read of a particle, packed against the full precision copies
+        int dimensions = Sph3d::enabled ? 3 : 2;
+        int scalar = Particle::doublePrecision ? (int)sizeof(double) : (int)sizeof(float);
+        int motion = Sph3d::enabled ? (int)sizeof(SphSolver<3, float>::PackedMotion) : (int)sizeof(SphSolver<2, float>::PackedMotion);
+        int packed = dimensions * (int)sizeof(unsigned short) + motion + (Multires::enabled ? 1 : 0);
+        int copied = (2 * dimensions + 2 + (Multires::enabled ? 2 : 0)) * scalar + (int)sizeof(int);
+#if USE_CPP_IOSTREAM
+        std::cout << "Compact: " << packed << " bytes per particle for the force tiles instead of " << copied << std::endl;
+#else
+        printf( "Compact: %d bytes per particle for the force tiles instead of %d\n", packed, copied );
+#endif
+    }
+
+    if (Multires::enabled) {
+        // levels from the particle sizes, the total mass is the spawned particle count when it is conserved
+        int dimensions = Sph3d::enabled ? 3 : 2;
+        storeSph();
+        std::vector <int> levels(Multires::maxLevel - Multires::minLevel + 1, 0);
+        double mass = 0.0;
+        for (int i = 0; i < Particle::particles.size(); i++) {
+            double size = Particle::particles[i].scale;
+            int level = (int)std::lround(dimensions * std::log2(size));
+            levels[glm::clamp(level, Multires::minLevel, Multires::maxLevel) - Multires::minLevel]++;
+            mass += std::pow(size, (double)dimensions);
+        }
+#if USE_CPP_IOSTREAM
+        std::cout << "Multires: " << Multires::numSplits << " splits, " << Multires::numMerges << " merges, mass " << std::setprecision(1) << mass << ", particles by level:";
+        for (int l = 0; l < levels.size(); l++) std::cout << " " << Multires::minLevel + l << ": " << levels[l];
+        std::cout << std::endl;
+#else
+        printf( "Multires: %d splits, %d merges, mass %.1f, particles by level:", Multires::numSplits, Multires::numMerges, mass );
+        for (int l = 0; l < levels.size(); l++) printf( " %d: %d", Multires::minLevel + l, levels[l] );
+        printf( "\n" );
+#endif
+    }
+
+    if (Obstacles::enabled) {
+        // what the cells passed on to the narrow phase, against testing every particle with every obstacle
+        double steps = (double)std::max(Particle::numSteps, 1);
+        double pairs = (double)Obstacles::numPairs / steps;
+        double allPairs = (double)Emitters::liveCount() * Obstacles::count;
+#if USE_CPP_IOSTREAM
+        std::cout << "Obstacles: " << Obstacles::count << ", avg " << std::setprecision(0) << pairs << " particle pairs per step from their cells, "
+                  << allPairs << " without the broadphase" << std::endl;
+#else
+        printf( "Obstacles: %d, avg %.0f particle pairs per step from their cells, %.0f without the broadphase\n", Obstacles::count, pairs, allPairs );
+#endif
+    }
+
+    if (Emitters::enabled) {
+#if USE_CPP_IOSTREAM
+        std::cout << "Flow: " << Emitters::numEmitted << " emitted, " << Emitters::numRemoved << " removed, " << Emitters::numBlocked
+                  << " blocked by a full pool, " << Emitters::numLive << " live in " << Emitters::numSlots << " of " << Emitters::capacity
+                  << " slots, " << Emitters::numCompactions << " compactions" << std::endl;
+#else
+        printf( "Flow: %lld emitted, %lld removed, %lld blocked by a full pool, %d live in %d of %d slots, %d compactions\n",
+            Emitters::numEmitted, Emitters::numRemoved, Emitters::numBlocked, Emitters::numLive, Emitters::numSlots, Emitters::capacity, Emitters::numCompactions );
+#endif
+    }
+
+    Metrics::summary();
+
+    if (!Sph3d::enabled && !GpuSolver::enabled) {
+        const SparseGrid& cells = Particle::cells;
+#if USE_CPP_IOSTREAM
+        std::cout << "Cells: " << cells.numBlocks() << " blocks of " << (int)SparseGrid::BLOCK << "x" << (int)SparseGrid::BLOCK
+            << ", " << cells.footprint() << " bytes" << std::endl;
+#else
+        printf( "Cells: %d blocks of %dx%d, %d bytes\n", cells.numBlocks(), (int)SparseGrid::BLOCK, (int)SparseGrid::BLOCK, (int)cells.footprint() );
+#endif
+    }
+
+    if (surface) {
+        size_t particleBytes = Particle::particles.size() * sizeof(Particle);
+#if USE_CPP_IOSTREAM
+        std::cout
+            << "Surface: " << Surface::polyStarts.size() << " polylines, " << Surface::vertices.size() / 2 << " vertices, "
+            << Surface::footprint() << " bytes (particles: " << particleBytes << " bytes)" << std::endl;
+#else
+        printf( "Surface: %d polylines, %d vertices, %d bytes (particles: %d bytes)\n", (int)Surface::polyStarts.size(), (int)Surface::vertices.size() / 2, (int)Surface::footprint(), (int)particleBytes );
+#endif
+    }
+
+    if (exportPath && !Surface::exportOBJ(exportPath)) {
+#if USE_CPP_IOSTREAM
+        std::cout << "ERROR: Could not write surface to " << exportPath << std::endl;
+#else
+        printf( "ERROR: Could not write surface to %s\n", exportPath );
+#endif
+    }
+
     glDeleteProgram(shader);
 
     glfwTerminate();
@@ -0,0 +1,281 @@
+#include "../HeaderFiles/Metrics.h"
+#include "../HeaderFiles/Window.h"
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+//Defining static members
+bool Metrics::gpuTimers = false;
+double Metrics::cpuMs[CPU_TIMERS] = {};
+double Metrics::gpuMs[GPU_TIMERS] = {};
+double Metrics::gpuFrameMs = 0.0;
+int Metrics::gpuFrame = -1;
+double Metrics::timeToFirstFrameMs = 0.0;
+double Metrics::activeFraction = -1.0;
+
+static const char* cpuNames[Metrics::CPU_TIMERS] = { "physics", "surface", "upload", "draw", "swap" };
+static const char* gpuNames[Metrics::GPU_TIMERS] = { "boundary", "particles", "surface" };
+
+struct FrameQueries
+{
+	int frame = -1;
+	double cpuMs[Metrics::CPU_TIMERS] = {};
+	double active = -1.0;
+	unsigned int elapsed[Metrics::GPU_TIMERS] = {};
+	unsigned int stamps[2] = {};
+	bool issued[Metrics::GPU_TIMERS] = {};
+};
+
+static FrameQueries ring[Metrics::LATENCY];
+static int slot = -1;
+static double cpuStart[Metrics::CPU_TIMERS] = {};
+static std::ofstream csv;
+
+// running totals for the summary
+static double cpuTotal[Metrics::CPU_TIMERS] = {};
+static double gpuTotal[Metrics::GPU_TIMERS] = {};
+static double gpuFrameTotal = 0.0;
+static double activeTotal = 0.0;
+static int cpuFrames = 0;
+static int activeFrames = 0;
+static int gpuFrames = 0;
+static int gpuWaited = 0;       // resolved only by the wait at shutdown
+static int gpuNegative = 0;     // frames with a timer that went backwards
+static int gpuOpen = -1;        // timer whose query is active, one GL_TIME_ELAPSED query can be at a time
+static int gpuUnpaired = 0;     // beginGpu while another timer was open, or endGpu of a timer that was not
+
+// startup phases, timed from static initialization (as close to process start as we get)
+static std::chrono::steady_clock::time_point processStart = std::chrono::steady_clock::now();
+static std::chrono::steady_clock::time_point phaseStart = processStart;
+static std::vector<const char*> phaseNames;
+static std::vector<double> phaseMs;
+
+static double queryMs(unsigned int query) {
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+    return (double)ns * 1e-6;
+}
+
+// Reads a slot back. Without wait the GPU values are skipped if the driver is not done with them yet.
+static void resolve(FrameQueries& q, bool wait) {
+    if (q.frame < 0) return;
+    int frame = q.frame;
+    q.frame = -1;
+
+    double gpu[Metrics::GPU_TIMERS] = {};
+    double gpuFrameMs = 0.0;
+    bool ready = Metrics::gpuTimers;
+    if (ready && !wait) {
+        int available = 0;
+        glGetQueryObjectiv(q.stamps[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        ready = (available != 0);
+    }
+    if (ready) {
+        for (int i = 0; i < Metrics::GPU_TIMERS; i++)
+            if (q.issued[i]) gpu[i] = queryMs(q.elapsed[i]);
+        gpuFrameMs = queryMs(q.stamps[1]) - queryMs(q.stamps[0]);
+
+        for (int i = 0; i < Metrics::GPU_TIMERS; i++) {
+            Metrics::gpuMs[i] = gpu[i];
+            gpuTotal[i] += gpu[i];
+        }
+        Metrics::gpuFrameMs = gpuFrameMs;
+        Metrics::gpuFrame = frame;
+        gpuFrameTotal += gpuFrameMs;
+        gpuFrames++;
+        if (wait) gpuWaited++;
+        bool negative = gpuFrameMs < 0.0;
+        for (int i = 0; i < Metrics::GPU_TIMERS; i++) negative = negative || gpu[i] < 0.0;
+        if (negative) gpuNegative++;
+    }
+
+    // frames whose GPU results were not ready in time keep their CPU columns only
+    if (csv.is_open()) {
+        csv << frame;
+        for (int i = 0; i < Metrics::CPU_TIMERS; i++) csv << "," << q.cpuMs[i];
+        for (int i = 0; i < Metrics::GPU_TIMERS; i++) {
+            csv << ",";
+            if (ready) csv << gpu[i];
+        }
+        csv << ",";
+        if (ready) csv << gpuFrameMs;
+        csv << ",";
+        if (q.active >= 0.0) csv << q.active;
+        csv << "\n";
+    }
+}
+
+void Metrics::init() {
+    // timer queries are core since 3.3, llvmpipe exposes them too
+    gpuTimers = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if (!gpuTimers) return;
+    for (int i = 0; i < LATENCY; i++) {
+        glGenQueries(GPU_TIMERS, ring[i].elapsed);
+        glGenQueries(2, ring[i].stamps);
+    }
+}
+
+bool Metrics::open(const std::string& filePath) {
+    csv.open(filePath);
+    if (!csv) return false;
+    csv << "frame";
+    for (int i = 0; i < CPU_TIMERS; i++) csv << ",cpu_" << cpuNames[i] << "_ms";
+    for (int i = 0; i < GPU_TIMERS; i++) csv << ",gpu_" << gpuNames[i] << "_ms";
+    csv << ",gpu_frame_ms,active_fraction\n";
+    return true;
+}
+
+// CPU timers of a frame are complete once the swap after it has been timed
+static void closeFrame() {
+    if (slot < 0) return;
+    FrameQueries& q = ring[slot];
+    for (int i = 0; i < Metrics::CPU_TIMERS; i++) {
+        q.cpuMs[i] = Metrics::cpuMs[i];
+        cpuTotal[i] += Metrics::cpuMs[i];
+    }
+    cpuFrames++;
+    q.active = Metrics::activeFraction;
+    if (q.active >= 0.0) {
+        activeTotal += q.active;
+        activeFrames++;
+    }
+}
+
+void Metrics::beginFrame(int frame) {
+    closeFrame();
+    slot = frame % LATENCY;
+    FrameQueries& q = ring[slot];
+    resolve(q, false);
+
+    q.frame = frame;
+    for (int i = 0; i < GPU_TIMERS; i++) q.issued[i] = false;
+    for (int i = 0; i < CPU_TIMERS; i++) cpuMs[i] = 0.0;
+    if (gpuTimers) glQueryCounter(q.stamps[0], GL_TIMESTAMP);
+}
+
+void Metrics::endFrame() {
+    if (gpuTimers) glQueryCounter(ring[slot].stamps[1], GL_TIMESTAMP);
+}
+
+void Metrics::beginCpu(int timer) {
+    cpuStart[timer] = glfwGetTime();
+}
+
+void Metrics::endCpu(int timer) {
+    cpuMs[timer] += (glfwGetTime() - cpuStart[timer]) * 1000.0;
+}
+
+void Metrics::beginGpu(int timer) {
+    if (!gpuTimers) return;
+    if (gpuOpen >= 0) {
+        gpuUnpaired++;
+        return;
+    }
+    gpuOpen = timer;
+    glBeginQuery(GL_TIME_ELAPSED, ring[slot].elapsed[timer]);
+    ring[slot].issued[timer] = true;
+}
+
+void Metrics::endGpu(int timer) {
+    if (!gpuTimers) return;
+    if (timer != gpuOpen) {
+        gpuUnpaired++;
+        if (gpuOpen < 0) return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    gpuOpen = -1;
+}
+
+void Metrics::startupPhase(const char* name) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    phaseNames.push_back(name);
+    phaseMs.push_back(std::chrono::duration<double, std::milli>(now - phaseStart).count());
+    phaseStart = now;
+    timeToFirstFrameMs = std::chrono::duration<double, std::milli>(now - processStart).count();
+}
+
+void Metrics::finish() {
+    // the last frames in flight are read back with a wait, we are shutting down anyway
+    closeFrame();
+    if (slot < 0) return;
+    for (int i = 1; i <= LATENCY; i++) resolve(ring[(slot + i) % LATENCY], true);
+    if (csv.is_open()) csv.close();
+}
+
+void Metrics::print() {
+#if USE_CPP_IOSTREAM
+    std::cout << "    CPU ms:";
+    for (int i = 0; i < CPU_TIMERS; i++) std::cout << " " << cpuNames[i] << " " << std::setw(7) << std::setprecision(3) << cpuMs[i];
+    if (gpuTimers) {
+        std::cout << "  GPU ms (frame " << gpuFrame << "):";
+        for (int i = 0; i < GPU_TIMERS; i++) std::cout << " " << gpuNames[i] << " " << std::setw(7) << std::setprecision(3) << gpuMs[i];
+        std::cout << " total " << std::setw(7) << std::setprecision(3) << gpuFrameMs;
+    }
+    std::cout << std::endl;
+#else
+    printf( "    CPU ms:" );
+    for (int i = 0; i < CPU_TIMERS; i++) printf( " %s %7.3f", cpuNames[i], cpuMs[i] );
+    if (gpuTimers) {
+        printf( "  GPU ms (frame %d):", gpuFrame );
+        for (int i = 0; i < GPU_TIMERS; i++) printf( " %s %7.3f", gpuNames[i], gpuMs[i] );
+        printf( " total %7.3f", gpuFrameMs );
+    }
+    printf( "\n" );
+#endif
+}
+
+void Metrics::summary() {
+    double cpuFramesD = (double)std::max(cpuFrames, 1);
+    double gpuFramesD = (double)std::max(gpuFrames, 1);
+#if USE_CPP_IOSTREAM
+    std::cout << "Startup ms:";
+    for (int i = 0; i < phaseNames.size(); i++) std::cout << " " << phaseNames[i] << " " << std::setw(7) << std::setprecision(3) << phaseMs[i];
+    std::cout << "  Time to first frame: " << std::setw(7) << std::setprecision(3) << timeToFirstFrameMs << " ms" << std::endl;
+    std::cout << "Avg CPU ms:";
+    for (int i = 0; i < CPU_TIMERS; i++) std::cout << " " << cpuNames[i] << " " << std::setw(7) << std::setprecision(3) << cpuTotal[i] / cpuFramesD;
+    std::cout << std::endl;
+    if (gpuTimers) {
+        std::cout << "Avg GPU ms:";
+        for (int i = 0; i < GPU_TIMERS; i++) std::cout << " " << gpuNames[i] << " " << std::setw(7) << std::setprecision(3) << gpuTotal[i] / gpuFramesD;
+        std::cout << " total " << std::setw(7) << std::setprecision(3) << gpuFrameTotal / gpuFramesD
+                  << " (" << gpuFrames << " of " << cpuFrames << " frames resolved)" << std::endl;
+    }
+    else
+        std::cout << "Avg GPU ms: n/a (no timer queries)" << std::endl;
+    if (activeFrames > 0)
+        std::cout << "Avg active: " << std::setprecision(3) << 100.0 * activeTotal / activeFrames << "% of particles" << std::endl;
+#else
+    printf( "Startup ms:" );
+    for (int i = 0; i < phaseNames.size(); i++) printf( " %s %7.3f", phaseNames[i], phaseMs[i] );
+    printf( "  Time to first frame: %7.3f ms\n", timeToFirstFrameMs );
+    printf( "Avg CPU ms:" );
+    for (int i = 0; i < CPU_TIMERS; i++) printf( " %s %7.3f", cpuNames[i], cpuTotal[i] / cpuFramesD );
+    printf( "\n" );
+    if (gpuTimers) {
+        printf( "Avg GPU ms:" );
+        for (int i = 0; i < GPU_TIMERS; i++) printf( " %s %7.3f", gpuNames[i], gpuTotal[i] / gpuFramesD );
+        printf( " total %7.3f (%d of %d frames resolved)\n", gpuFrameTotal / gpuFramesD, gpuFrames, cpuFrames );
+    }
+    else
+        printf( "Avg GPU ms: n/a (no timer queries)\n" );
+    if (activeFrames > 0)
+        printf( "Avg active: %.1f%% of particles\n", 100.0 * activeTotal / activeFrames );
+#endif
+}
+
+bool Metrics::validate(int frames) {
+    // every frame read back, and only the frames still in flight at shutdown by waiting for them
+    int inTime = gpuFrames - gpuWaited;
+    bool passed = gpuTimers && cpuFrames == frames && gpuFrames == cpuFrames && inTime >= frames - LATENCY && gpuNegative == 0
+        && gpuUnpaired == 0;
+#if USE_CPP_IOSTREAM
+    std::cout << "Metrics check: " << (gpuTimers ? "timer queries" : "no timer queries") << ", " << gpuFrames << " of " << cpuFrames
+              << " frames resolved, " << inTime << " without waiting, " << gpuNegative << " with negative times, "
+              << gpuUnpaired << " unpaired, " << (passed ? "PASSED" : "FAILED") << std::endl;
+#else
+    printf( "Metrics check: %s, %d of %d frames resolved, %d without waiting, %d with negative times, %d unpaired, %s\n",
+        gpuTimers ? "timer queries" : "no timer queries", gpuFrames, cpuFrames, inTime, gpuNegative, gpuUnpaired, passed ? "PASSED" : "FAILED" );
+#endif
+    return passed;
+}
@@ -0,0 +1,139 @@
+#include "../HeaderFiles/Multires.h"
+#include "../HeaderFiles/SphSolver.h"
+
+//Defining static members
+int Multires::numSplits = 0;
+int Multires::numMerges = 0;
+
+enum Action { KEEP, SPLIT, MERGE };
+
+static std::vector <int> actions;
+static std::vector <int> partners;
+
+template <int D, typename T>
+static T smoothingLength(int level) {
+    return (T)Particle::s_Radius * std::pow(T(2), T(level) / T(D));
+}
+
+template <int D, typename T>
+static glm::vec<D, T, glm::defaultp> randomDirection() {
+    // glm::linearRand shares one generator, so splitting stays serial
+    glm::vec<D, T, glm::defaultp> dir;
+    T length;
+    do {
+        for (int k = 0; k < D; k++) dir[k] = (T)glm::linearRand(-1.0f, 1.0f);
+        length = glm::length(dir);
+    } while (length < T(0.1) || length > T(1));
+    return dir / length;
+}
+
+template <int D, typename T>
+void Multires::refine() {
+    typedef SphSolver<D, T> Solver;
+    typedef typename Solver::State State;
+    typedef typename Solver::vec vec;
+    std::vector <State>& particles = Solver::particles;
+    int count = (int)particles.size();
+    int changes = numSplits + numMerges;
+    actions.resize(count);
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) {
+        State& p = particles[i];
+        p.age++;
+        actions[i] = KEEP;
+        // with local steps only particles that have just been kicked, so that their steps line up
+        if (p.age < minAge || p.asleep || p.elapsed > T(0)) continue;
+        if (p.level > minLevel && (p.surface > (T)splitSurface || p.vorticity > (T)splitVorticity))
+            actions[i] = SPLIT;
+        else if (p.level < maxLevel && p.surface < (T)mergeSurface && p.vorticity < (T)mergeVorticity)
+            actions[i] = MERGE;
+    }
+
+    // pair each candidate with its nearest free candidate of the same level, through this step's cells;
+    // serial so that a particle joins one pair only
+    partners.assign(count, -1);
+    for (int i = 0; i < count; i++) {
+        if (actions[i] != MERGE || partners[i] >= 0) continue;
+        const State& p = particles[i];
+        typename Solver::CellBlock local;
+        const glm::ivec3& home = Solver::cellCoords[Solver::particleCell[i]];
+        const typename Solver::CellBlock& block = Solver::blockOf(p.pos, home, p.h, local);
+        int best = -1;
+        T bestDst = p.h;
+        for (int z = block.lo.z; z <= block.hi.z; z++) {
+            for (int y = block.lo.y; y <= block.hi.y; y++) {
+                for (int x = block.lo.x; x <= block.hi.x; x++) {
+                    vec shift = vec(T(0));
+                    int c = Solver::findCell(home + glm::ivec3(x, y, z), shift);
+                    if (c < 0) continue;
+                    for (int k = Solver::cellStart[c]; k < Solver::cellStart[c + 1]; k++) {
+                        int j = Solver::sorted[k];
+                        if (j == i || actions[j] != MERGE || partners[j] >= 0 || particles[j].level != p.level) continue;
+                        T dst = glm::length(particles[j].pos + shift - p.pos);
+                        if (dst < bestDst) best = j, bestDst = dst;
+                    }
+                }
+            }
+        }
+        if (best >= 0) partners[i] = best, partners[best] = i;
+    }
+
+    // swapped with the particles every step, so both keep their capacity
+    static std::vector <State> refined;
+    refined.clear();
+    refined.reserve(count + count / 8);
+    T spacing = (T)(2.0f * Particle::radius + Particle::spacing);
+    for (int i = 0; i < count; i++) {
+        const State& p = particles[i];
+        if (actions[i] == MERGE && partners[i] >= 0) {
+            if (partners[i] < i) continue;
+            // one particle at the center of mass carrying the pair's mass and momentum
+            const State& n = particles[partners[i]];
+            State m = p;
+            m.mass = p.mass + n.mass;
+            T a = p.mass / m.mass;
+            T b = n.mass / m.mass;
+            m.pos = a * p.pos + b * n.pos;
+            m.predictedPos = a * p.predictedPos + b * n.predictedPos;
+            m.velocity = a * p.velocity + b * n.velocity;
+            m.acceleration = a * p.acceleration + b * n.acceleration;
+            m.density = a * p.density + b * n.density;
+            m.nearDensity = a * p.nearDensity + b * n.nearDensity;
+            m.viscosityRate = std::max(p.viscosityRate, n.viscosityRate);
+            m.vorticity = std::max(p.vorticity, n.vorticity);
+            m.surface = std::max(p.surface, n.surface);
+            m.rung = std::min(p.rung, n.rung);
+            m.opened = a * p.opened + b * n.opened;
+            m.level = p.level + 1;
+            m.h = smoothingLength<D, T>(m.level);
+            m.age = 0;
+            refined.push_back(m);
+            numMerges++;
+        }
+        else if (actions[i] == SPLIT) {
+            // two halves with the same velocity either side of the parent, a child's spacing apart
+            State c = p;
+            c.mass = p.mass / T(2);
+            c.level = p.level - 1;
+            c.h = smoothingLength<D, T>(c.level);
+            c.age = 0;
+            vec offset = randomDirection<D, T>() * (T(0.5) * spacing * c.h / (T)Particle::s_Radius);
+            c.pos = p.pos + offset;
+            c.predictedPos = p.predictedPos + offset;
+            refined.push_back(c);
+            c.pos = p.pos - offset;
+            c.predictedPos = p.predictedPos - offset;
+            refined.push_back(c);
+            numSplits++;
+        }
+        else refined.push_back(p);
+    }
+    particles.swap(refined);
+    if (numSplits + numMerges != changes) Solver::reindexed = true;
+}
+
+template void Multires::refine<2, float>();
+template void Multires::refine<3, float>();
+template void Multires::refine<2, double>();
+template void Multires::refine<3, double>();
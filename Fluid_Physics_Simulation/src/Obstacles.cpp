@@ -0,0 +1,233 @@
+#include "../HeaderFiles/Obstacles.h"
+#include "../HeaderFiles/SphSolver.h"
+#include "../HeaderFiles/Arena.h"
+
+//Defining static members
+std::vector <Obstacles::Obstacle> Obstacles::obstacles;
+std::vector <int> Obstacles::cellStart;
+glm::ivec2 Obstacles::binLower = glm::ivec2(0);
+glm::ivec2 Obstacles::binSize = glm::ivec2(0);
+std::vector <int> Obstacles::cellObstacles;
+long long Obstacles::numPairs = 0;
+unsigned int Obstacles::vao = 0;
+unsigned int Obstacles::vbo = 0;
+
+static const float PI = 3.1415926535897932384626433832f;
+
+// outlines rebuilt every frame
+static std::vector <float> outline;
+static std::vector <int> outlineStarts;
+static std::vector <glm::vec2> corners;     // one obstacle's outline around its center
+
+void Obstacles::generate() {
+    // rows of alternating shapes across the bottom of the box where the fluid settles, each circling
+    // its own anchor at its own rate so that together they stir the whole pool
+    obstacles.resize(count);
+    int cols = (int)std::ceil(std::sqrt(4.0f * count));
+    int rows = (count + cols - 1) / cols;
+    glm::vec2 lower(-0.8f, -0.85f), upper(0.8f, -0.45f);
+    glm::vec2 spacing = (upper - lower) / glm::vec2(cols, rows);
+    float s = std::min(spacing.x, spacing.y);
+    for (int k = 0; k < count; k++) {
+        Obstacle& o = obstacles[k];
+        o.shape = k % SHAPES;
+        if (o.shape == CIRCLE) o.size = glm::vec2(0.3f * s);
+        if (o.shape == BOX) o.size = glm::vec2(0.35f * s, 0.15f * s);
+        if (o.shape == CAPSULE) o.size = glm::vec2(0.25f * s, 0.1f * s);
+        o.anchor = lower + (glm::vec2(k % cols, k / cols) + 0.5f) * spacing;
+        o.amplitude = 0.5f * spacing;
+        // golden ratio steps keep neighbors out of phase
+        float g = std::fmod(0.618034f * k, 1.0f);
+        o.frequency = 0.5f + g;
+        o.phase = 2.0f * PI * g;
+        o.spin = o.shape == CIRCLE ? 0.0f : (k % 2 ? 1.0f : -1.0f) * 2.0f * PI * o.frequency;
+    }
+    update(0.0);
+}
+
+void Obstacles::update(double time) {
+#pragma omp parallel for schedule(static)
+    for (int k = 0; k < count; k++) {
+        Obstacle& o = obstacles[k];
+        float w = 2.0f * PI * o.frequency;
+        float a = w * (float)time + o.phase;
+        o.pos = o.anchor + o.amplitude * glm::vec2(std::cos(a), std::sin(a));
+        o.velocity = o.amplitude * w * glm::vec2(-std::sin(a), std::cos(a));
+        o.angle = o.spin * (float)time;
+
+        float c = std::abs(std::cos(o.angle)), s = std::abs(std::sin(o.angle));
+        glm::vec2 extent = o.size;
+        if (o.shape == BOX) extent = glm::vec2(c * o.size.x + s * o.size.y, s * o.size.x + c * o.size.y);
+        if (o.shape == CAPSULE) extent = glm::vec2(c * o.size.x, s * o.size.x) + o.size.y;
+        o.lower = o.pos - extent;
+        o.upper = o.pos + extent;
+    }
+}
+
+template <int D, typename T>
+void Obstacles::bin() {
+    // counting sort of the obstacles into every cell their bounds, grown by the largest particle, overlap,
+    // over the rectangle of the solver's cells that the obstacles span
+    typedef SphSolver<D, T> Solver;
+    float margin = Particle::radius * (float)Solver::maxSmoothing / Particle::s_Radius;
+    Arena& arena = Arena::local();
+    glm::ivec4* ranges = arena.alloc<glm::ivec4>(count);
+    glm::ivec2 lo(0), hi(-1);
+    for (int k = 0; k < count; k++) {
+        const Obstacle& o = obstacles[k];
+        glm::ivec4& r = ranges[k];
+        for (int d = 0; d < 2; d++) {
+            float cellSize = (float)Solver::cellWidth[d];
+            r[2 * d] = (int)std::floor((o.lower[d] - margin - (float)Solver::lower[d]) / cellSize);
+            r[2 * d + 1] = (int)std::floor((o.upper[d] + margin - (float)Solver::lower[d]) / cellSize);
+            lo[d] = k == 0 ? r[2 * d] : std::min(lo[d], r[2 * d]);
+            hi[d] = k == 0 ? r[2 * d + 1] : std::max(hi[d], r[2 * d + 1]);
+        }
+    }
+    binLower = lo;
+    binSize = hi - lo + 1;
+    int cells = binSize.x * binSize.y;
+    cellStart.assign(cells + 1, 0);
+    for (int k = 0; k < count; k++) {
+        const glm::ivec4& r = ranges[k];
+        for (int y = r[2]; y <= r[3]; y++)
+            for (int x = r[0]; x <= r[1]; x++) cellStart[x - lo.x + binSize.x * (y - lo.y) + 1]++;
+    }
+    for (int c = 0; c < cells; c++) cellStart[c + 1] += cellStart[c];
+    cellObstacles.resize(cellStart[cells]);
+    int* cursor = arena.alloc<int>(cells);
+    std::copy(cellStart.begin(), cellStart.end() - 1, cursor);
+    for (int k = 0; k < count; k++) {
+        const glm::ivec4& r = ranges[k];
+        for (int y = r[2]; y <= r[3]; y++)
+            for (int x = r[0]; x <= r[1]; x++) cellObstacles[cursor[x - lo.x + binSize.x * (y - lo.y)]++] = k;
+    }
+
+    // the narrow phase tests, from the last sort's cells
+    for (int c = 0; c + 1 < Solver::cellStart.size(); c++) {
+        int cell = binOf(glm::ivec2(Solver::cellCoords[c]));
+        if (cell >= 0) numPairs += (long long)(cellStart[cell + 1] - cellStart[cell]) * (Solver::cellStart[c + 1] - Solver::cellStart[c]);
+    }
+}
+
+int Obstacles::binOf(glm::ivec2 cell) {
+    glm::ivec2 b = cell - binLower;
+    if (b.x < 0 || b.y < 0 || b.x >= binSize.x || b.y >= binSize.y) return -1;
+    return b.x + binSize.x * b.y;
+}
+
+bool Obstacles::covers(glm::ivec2 cell) {
+    int b = binOf(cell);
+    return b >= 0 && cellStart[b + 1] > cellStart[b];
+}
+
+bool Obstacles::collide(glm::ivec2 cell, glm::vec2& pos, glm::vec2& velocity, float radius) {
+    bool hit = false;
+    int b = binOf(cell);
+    if (b < 0) return false;
+    for (int k = cellStart[b]; k < cellStart[b + 1]; k++) {
+        const Obstacle& o = obstacles[cellObstacles[k]];
+        if (pos.x < o.lower.x - radius || pos.x > o.upper.x + radius || pos.y < o.lower.y - radius || pos.y > o.upper.y + radius)
+            continue;
+
+        // distance and outward normal in the obstacle's frame
+        float c = std::cos(o.angle), s = std::sin(o.angle);
+        glm::vec2 d = pos - o.pos;
+        glm::vec2 local(c * d.x + s * d.y, -s * d.x + c * d.y);
+        glm::vec2 normal(0.0f, 1.0f);
+        float distance;
+        if (o.shape == BOX) {
+            glm::vec2 q = glm::abs(local) - o.size;
+            glm::vec2 outside = glm::max(q, glm::vec2(0.0f));
+            float length = glm::length(outside);
+            if (length > 0.0f) {
+                distance = length;
+                normal = glm::sign(local) * outside / length;
+            }
+            else {
+                distance = std::max(q.x, q.y);
+                normal = q.x > q.y ? glm::vec2(local.x < 0.0f ? -1.0f : 1.0f, 0.0f) : glm::vec2(0.0f, local.y < 0.0f ? -1.0f : 1.0f);
+            }
+        }
+        else {
+            // a circle is a capsule without length
+            float length = o.shape == CAPSULE ? o.size.x : 0.0f;
+            float r = o.shape == CAPSULE ? o.size.y : o.size.x;
+            glm::vec2 e = local - glm::vec2(glm::clamp(local.x, -length, length), 0.0f);
+            float l = glm::length(e);
+            if (l > 1e-6f) normal = e / l;
+            distance = l - r;
+        }
+        if (distance >= radius) continue;
+
+        // out along the normal, the velocity into the surface reflected at half speed relative to it
+        glm::vec2 n(c * normal.x - s * normal.y, s * normal.x + c * normal.y);
+        pos += (radius - distance) * n;
+        glm::vec2 arm = pos - o.pos;
+        glm::vec2 surface = o.velocity + o.spin * glm::vec2(-arm.y, arm.x);
+        float speed = glm::dot(velocity - surface, n);
+        if (speed < 0.0f) velocity -= 1.5f * speed * n;
+        hit = true;
+    }
+    return hit;
+}
+
+void Obstacles::drawElements(int object_Location, int color_Location) {
+    outline.clear();
+    outlineStarts.clear();
+    const int arc = 12;
+    for (int k = 0; k < count; k++) {
+        const Obstacle& o = obstacles[k];
+        outlineStarts.push_back((int)outline.size() / 2);
+        corners.clear();
+        if (o.shape == BOX) {
+            corners.push_back(glm::vec2(-o.size.x, -o.size.y));
+            corners.push_back(glm::vec2(o.size.x, -o.size.y));
+            corners.push_back(glm::vec2(o.size.x, o.size.y));
+            corners.push_back(glm::vec2(-o.size.x, o.size.y));
+        }
+        else {
+            // two half circles, which meet for a circle
+            float length = o.shape == CAPSULE ? o.size.x : 0.0f;
+            float r = o.shape == CAPSULE ? o.size.y : o.size.x;
+            for (int i = 0; i <= arc; i++) {
+                float a = -0.5f * PI + PI * i / arc;
+                corners.push_back(glm::vec2(length + r * std::cos(a), r * std::sin(a)));
+            }
+            for (int i = 0; i <= arc; i++) {
+                float a = 0.5f * PI + PI * i / arc;
+                corners.push_back(glm::vec2(-length + r * std::cos(a), r * std::sin(a)));
+            }
+        }
+        float c = std::cos(o.angle), s = std::sin(o.angle);
+        for (int i = 0; i < corners.size(); i++) {
+            outline.push_back(o.pos.x + c * corners[i].x - s * corners[i].y);
+            outline.push_back(o.pos.y + s * corners[i].x + c * corners[i].y);
+        }
+    }
+    outlineStarts.push_back((int)outline.size() / 2);
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, outline.size() * sizeof(float), outline.data(), GL_STREAM_DRAW);
+
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    // not instanced: unit scale, grey
+    glVertexAttrib3f(1, 0.0f, 0.0f, 1.0f);
+    glVertexAttrib3f(2, 0.7f, 0.7f, 0.7f);
+
+    glUniform4f(object_Location, 0.0f, 0.0f, 0.0f, 0.0f);
+    glUniform3f(color_Location, 0.7f, 0.7f, 0.7f);
+
+    for (int k = 0; k < count; k++)
+        glDrawArrays(GL_LINE_LOOP, outlineStarts[k], outlineStarts[k + 1] - outlineStarts[k]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+template void Obstacles::bin<2, float>();
+template void Obstacles::bin<3, float>();
+template void Obstacles::bin<2, double>();
+template void Obstacles::bin<3, double>();
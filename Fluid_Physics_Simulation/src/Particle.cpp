@@ -1,16 +1,31 @@
 #include "../HeaderFiles/Particle.h"
+#include "../HeaderFiles/SphSolver.h"
 
 #define M_PI 3.1415926535897932384626433832f
 
 //Defining static members
 std::vector <float> Particle::positions;
 std::vector <unsigned int> Particle::indices;
+std::vector <float> Particle::instances;
 std::vector <Particle> Particle::particles;
-int size = 2.0f / Particle::s_Radius;
-std::vector <std::vector <std::unordered_map<int, bool>>> Particle::cells(size, std::vector <std::unordered_map<int, bool>> (size));
+SparseGrid Particle::cells;
+std::vector <Span<int>> Particle::neighborLists;
 unsigned int Particle::vao = 0;
 unsigned int Particle::vbo = 0;
 unsigned int Particle::ibo = 0;
+unsigned int Particle::instanceVbo = 0;
+int Particle::lodFirst[3] = {};
+int Particle::lodCount[3] = {};
+int Particle::numVisible = 0;
+int Particle::numSplats = 0;
+float Particle::dt = 0.0f;
+const char* Particle::dtLimit = "fixed";
+double Particle::simulatedTime = 0.0;
+int Particle::numSteps = 0;
+const char* Particle::solverNames[Particle::SOLVERS] = { "sph", "pbf", "dfsph", "flip", "apic" };
+
+// splats are appended after the particle instances each frame
+static std::vector <float> splats;
 
 void checkBoundary(Particle& p) {
     float r = Particle::radius;
@@ -28,34 +43,41 @@ void checkBoundary(Particle& p) {
 }
 
 void Particle::generateRandomCenters() {
+    // glm::linearRand shares one generator, so this stays serial but fills a preallocated array
+    int first = (int)centers.size();
+    centers.resize(first + 2 * numOfParticles);
     for (int i = 0; i < numOfParticles; i++) {
-        Particle::centers.push_back(glm::linearRand(-0.9f + Particle::radius, 0.9f - Particle::radius));
-        Particle::centers.push_back(glm::linearRand(-0.9f + Particle::radius, 0.9f - Particle::radius));
+        Particle::centers[first + 2 * i]     = glm::linearRand(-0.9f + Particle::radius, 0.9f - Particle::radius);
+        Particle::centers[first + 2 * i + 1] = glm::linearRand(-0.9f + Particle::radius, 0.9f - Particle::radius);
     }
 }
 
 void Particle::generateGridCenters(int rows, int cols) {
     float left = 0.0f - (2 * Particle::radius + Particle::spacing) * cols / 2.0f;
     float top = 0.9f - (Particle::spacing + Particle::radius);
+    float step = 2 * Particle::radius + Particle::spacing;
+    int first = (int)centers.size();
+    centers.resize(first + 2 * rows * cols);
+
+#pragma omp parallel for schedule(static)
     for (int i = 0; i < rows; i++) {
-        
         for (int j = 0; j < cols; j++) {
-            Particle::centers.push_back(left + j * (2 * Particle::radius + Particle::spacing));
-            Particle::centers.push_back(top);
+            int k = first + 2 * (i * cols + j);
+            Particle::centers[k]     = left + j * step;
+            Particle::centers[k + 1] = top - i * step;
         }
-        top -= 2 * Particle::radius + Particle::spacing;
     }
 }
 
-void Particle::generateParticle(float aspectRatio) {
+void Particle::generateParticle(float aspectRatio, int segs) {
+    // every particle shares one disc mesh per level of detail, instancing places them
+    int startingIndex = (int)positions.size() / 2;
 
     positions.push_back(0.0f);
     positions.push_back(0.0f);
 
-    int startingIndex = (int)positions.size() / 2;
-
-    for (int i = 0; i <= segments; i++) {
-        float theta = 2.0f * M_PI * (float)i / (float)segments;
+    for (int i = 0; i <= segs; i++) {
+        float theta = 2.0f * M_PI * (float)i / (float)segs;
         float x = radius * cosf(theta);
         float y = radius * sinf(theta);
         positions.push_back((x) / aspectRatio);
@@ -71,44 +93,117 @@ void Particle::generateParticle(float aspectRatio) {
 
 void Particle::populate(float aspectRatio) {
     // generating Centers
-    for (int i = 0; i < centers.size(); i += 2) {
-        Particle p;
+    int first = (int)particles.size();
+    int count = (int)centers.size() / 2 - first;
+    particles.resize(first + count);
+
+#pragma omp parallel for schedule(static)
+    for (int i = first; i < first + count; i++) {
+        Particle& p = particles[i];
         p.velocity = glm::vec3(0.0f);
         p.acceleration = glm::vec3(0.0f);
-        p.pos = glm::vec3(centers[i], centers[i + 1], 0.0f);
+        p.viscosityRate = 0.0f;
+        p.pos = glm::vec3(centers[2 * i], centers[2 * i + 1], 0.0f);
+        p.predictedPos = p.pos;
         p.density = 0.0f;
-        p.generateParticle(aspectRatio);
-        particles.push_back(p);
+        p.nearDensity = 0.0f;
+        p.scale = 1.0f;
+    }
+
+    // populating cells, the grid is not safe to fill concurrently
+    if (cells.cellSize != s_Radius) rebuildCells();
+    else {
+        for (int i = first; i < first + count; i++) cells.insert(i, glm::vec2(particles[i].pos));
+    }
 
-        // populating cells
-        int x = (p.pos.x + 1.0f) / s_Radius;
-        int y = (p.pos.y + 1.0f) / s_Radius;
-        cells[x][y][i/2] = true;
+    // full, half and quarter resolution discs
+    positions.reserve(2 * 3 * (segments + 2));
+    indices.reserve(3 * 3 * segments);
+    for (int lod = 0; lod < 3; lod++) {
+        lodFirst[lod] = (int)indices.size();
+        generateParticle(aspectRatio, std::max(segments >> lod, 4));
+        lodCount[lod] = (int)indices.size() - lodFirst[lod];
     }
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 2, 0);
+    glEnableVertexAttribArray(0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+    // per instance: center.xy, scale, color.rgb
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(1, 1);
+    glVertexAttribDivisor(2, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Particle::updateCell(int idx) {
+    cells.move(idx, glm::vec2(particles[idx].pos));
 }
 
-void Particle::updateCell(int idx, int prevX, int prevY) {
-    cells[prevX][prevY][idx] = false;
-    int x = (particles[idx].pos.x + 1.0f) / s_Radius;
-    int y = (particles[idx].pos.y + 1.0f) / s_Radius;
-    cells[x][y][idx] = true;
+// every particle filed again, after s_Radius changed or the indices did
+void Particle::resetCells() {
+    // twice a cell's share of the resting lattice to start with. Walls and nozzles pack particles tighter,
+    // so it is no bound: a cell that fills up grows, and the grid keeps the largest capacity across rebuilds
+    int across = (int)std::ceil(s_Radius / (2.0f * radius + spacing));
+    cells.reset(s_Radius, 2 * across * across);
 }
 
-std::vector<Particle> Particle::findNeighbors(int idx) {
-    Particle& p = particles[idx];
-    int cellX = (p.pos.x + 1.0f) / s_Radius;
-    int cellY = (p.pos.y + 1.0f) / s_Radius;
-    std::vector <Particle> neighborsOut;
-    for (int i = -1; i <= 1; i++) {
-        if (cellX + i < 0 || cellX + i > size - 1) continue;
-        for (int j = -1; j <= 1; j++) {
-            if (cellY + j < 0 || cellY + j > size - 1) continue;
-            for (std::pair<int, bool> neighbor : cells[cellX + i][cellY + j]) {
-                if (neighbor.first != idx && neighbor.second) neighborsOut.push_back(particles[neighbor.first]);
+void Particle::rebuildCells() {
+    resetCells();
+    for (int i = 0; i < particles.size(); i++) cells.insert(i, glm::vec2(particles[i].pos));
+}
+
+int Particle::count() {
+    // only the SPH solver that runs loads the particles, Multires and Emitters change their count there
+    if (SphSolver<2, float>::loaded) return (int)SphSolver<2, float>::particles.size();
+    if (SphSolver<2, double>::loaded) return (int)SphSolver<2, double>::particles.size();
+    if (SphSolver<3, float>::loaded) return (int)SphSolver<3, float>::particles.size();
+    if (SphSolver<3, double>::loaded) return (int)SphSolver<3, double>::particles.size();
+    return (int)particles.size();
+}
+
+// index lists for the iterative solvers, which visit the same neighbors many times per step
+void Particle::gatherNeighbors() {
+    int count = (int)particles.size();
+    neighborLists.resize(count);
+
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < count; i++) {
+        int cellX = cells.cellOf(particles[i].pos.x);
+        int cellY = cells.cellOf(particles[i].pos.y);
+        const std::vector <int>* around[9];
+        int candidates = 0;
+        for (int x = cellX - 1, n = 0; x <= cellX + 1; x++) {
+            for (int y = cellY - 1; y <= cellY + 1; y++, n++) {
+                around[n] = &cells.cell(x, y);
+                candidates += (int)around[n]->size();
             }
         }
+        // every candidate fits, what is left over goes back to the thread's arena
+        Arena& arena = Arena::local();
+        Span <int>& list = neighborLists[i];
+        list.data = arena.alloc<int>(candidates);
+        list.count = 0;
+        for (int c = 0; c < 9; c++) {
+            const std::vector <int>& cell = *around[c];
+            for (int k = 0; k < cell.size(); k++) {
+                int j = cell[k];
+                if (j == i) continue;
+                if (glm::length(particles[j].pos - particles[i].pos) < s_Radius) list.data[list.count++] = j;
+            }
+        }
+        arena.trim(list.data, list.count);
     }
-    return neighborsOut;
 }
 
 float Particle::densityKernel(float dst) {
@@ -118,12 +213,6 @@ float Particle::densityKernel(float dst) {
     return val * val * val * scale;
 }
 
-float Particle::nearDensityKernel(float dst) {
-    if (dst >= s_Radius) return 0;
-    float val = 1 - dst / s_Radius;
-    return val * val * val;
-}
-
 float Particle::pressureKernel(float dst) {
     if (dst >= s_Radius) return 0;
     float scale = -30.0f / (M_PI * std::powf(s_Radius, 5.0f));
@@ -131,74 +220,8 @@ float Particle::pressureKernel(float dst) {
     return val * val * scale;
 }
 
-float Particle::nearPressureKernel(float dst) {
-    if (dst >= s_Radius) return 0;
-    float scale = -3.0f / s_Radius;
-    float val = 1 - dst / s_Radius;
-    return val * val * scale;
-}
-
-float Particle::viscosityKernel(float dst) {
-    if (dst >= s_Radius) return 0;
-    float scale = 40.0f / (M_PI * std::powf(s_Radius, 5.0f));
-    float val = s_Radius - dst;
-    return val * scale;
-}
-
-glm::vec3 Particle::pressure(int idx) {
-    glm::vec3 force = glm::vec3(0.0f);
-    std::vector <Particle> neighbors = findNeighbors(idx);
-    for (int i = 0; i < neighbors.size(); ++i) {
-        float dst = glm::length(neighbors[i].pos - particles[idx].pos);
-        if (dst < 1e-6f) continue;
-        glm::vec3 dir = (neighbors[i].pos - particles[idx].pos) / dst;
-        float dens = std::max(neighbors[i].density, 1e-4f);
-
-        float influence = pressureKernel(dst);
-        float nearInfluence = nearPressureKernel(dst);
-
-        float pressureA = (neighbors[i].density - targetDensity) * pressureMultiplier;
-        float pressureB = (particles[idx].density - targetDensity) * pressureMultiplier;
-
-        float nearPressure = neighbors[i].nearDensity * nearPressureMultiplier;
-
-        float sharedPressure = influence * (pressureA + pressureB) / (2.0f * dens);
-        sharedPressure += nearInfluence * nearPressure;
-        force += dir * sharedPressure;
-    }
-
-    return force + viscosity(idx, neighbors);
-}
-
-void Particle::calcuateDensities(int idx) {
-    float density = 0.0f;
-    float nearDensity = 0.0f;
-    Particle& p = particles[idx];
-    std::vector <Particle> neighbors = findNeighbors(idx);
-    for (int i = 0; i < neighbors.size(); i++) {
-        if (i == idx) continue;
-        float dst = glm::length(neighbors[i].predictedPos - particles[idx].predictedPos);
-        density += densityKernel(dst);
-        nearDensity += nearDensityKernel(dst);
-    }
-    p.density = density;
-    p.nearDensity = nearDensity;
-}
-
-glm::vec3 Particle::viscosity(int idx, std::vector<Particle> neighbors) {
-    glm::vec3 force = glm::vec3(0.0f);
-    for (int i = 0; i < neighbors.size(); ++i) {
-        float dst = glm::length(neighbors[i].pos - particles[idx].pos);
-        if (dst < 1e-6f) continue;
-        glm::vec3 dir = (neighbors[i].pos - particles[idx].pos) / dst;
-        float influence = viscosityKernel(dst);
-        force += (neighbors[i].velocity - particles[idx].velocity) * influence;
-    }
-    return force * viscosityMultiplier * particles[idx].density;
-}
-
-glm::vec3 velToColor(Particle p) {
-    float speed = glm::length(p.velocity);
+// blue when calm, red when fast, shared with the surface outline
+glm::vec3 speedToColor(float speed) {
     float scale = speed / 15.0f;
     glm::vec3 color = glm::vec3(0.0f);
     color.r = scale;
@@ -208,65 +231,133 @@ glm::vec3 velToColor(Particle p) {
     return color;
 }
 
-void Particle::drawElements(Window window, int object_Location, int color_Location, bool bDraw) {
-    if (bDraw)
-    {
-        glBindVertexArray(vao);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, 2 * centers.size() / 2 * (segments + 2) * sizeof(float), positions.data(), GL_DYNAMIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, 3 * centers.size() / 2 * (segments + 2) * sizeof(unsigned int), indices.data(), GL_DYNAMIC_DRAW);
-
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 2, 0);
-        glEnableVertexAttribArray(0);
-
-        // Draw Loop
-        for (int i = 0; i < particles.size(); ++i) {
-            Particle& p = particles[i];
-            glm::vec3 translate = glm::vec3(0.0f);
-            glm::vec3 color = velToColor(p);
+static int liveCount(int x, int y) {
+    return (int)Particle::cells.cell(x, y).size();
+}
 
-            glUniform4f(object_Location, p.pos.x+translate.x ,p.pos.y+translate.y , translate.z, 0.0f);
-            glUniform3f(color_Location, color.r, color.g, color.b);
+static void pushInstance(std::vector<float>& out, glm::vec3 pos, float scale, glm::vec3 color) {
+    out.push_back(pos.x);
+    out.push_back(pos.y);
+    out.push_back(scale);
+    out.push_back(color.r);
+    out.push_back(color.g);
+    out.push_back(color.b);
+}
 
-            glDrawElements(GL_TRIANGLES, 3 * segments, GL_UNSIGNED_INT, (void*)(i * 3 * segments * sizeof(unsigned int)));
+static void drawInstances(int first, int count, float radiusPx) {
+    if (count == 0) return;
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 6, (void*)(first * 6 * sizeof(float)));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 6, (void*)((first * 6 + 3) * sizeof(float)));
+
+    int lod = 0;
+    if (Camera::lod) {
+        if (radiusPx < Camera::pointPixels) {
+            // sub-pixel: the center vertex of the first disc is enough
+            glDrawArraysInstanced(GL_POINTS, 0, 1, count);
+            return;
         }
+        if (radiusPx < Camera::lowPixels) lod = 2;
+        else if (radiusPx < Camera::mediumPixels) lod = 1;
     }
+    glDrawElementsInstanced(GL_TRIANGLES, Particle::lodCount[lod], GL_UNSIGNED_INT, (void*)(Particle::lodFirst[lod] * sizeof(unsigned int)), count);
+}
 
-    // change position and cell
-    for (int i = 0; i < particles.size(); ++i) {
-        Particle& p = particles[i];
-        int x = (p.pos.x + 1.0f) / s_Radius;
-        int y = (p.pos.y + 1.0f) / s_Radius;
-        p.pos += stepSize * p.velocity;
-        checkBoundary(p);
-        updateCell(i, x, y);
+// the instances of the particles in the occupied cells the view overlaps, a particle may overhang its
+// cell by its radius; dense interior cells collapse into a single disc covering the cell
+template <typename View>
+static void fillInstances(const View& view, bool splat, float splatScale) {
+    const SparseGrid& cells = Particle::cells;
+    glm::vec2 lo, hi;
+    Camera::visibleBounds(lo, hi);
+    int x0 = cells.cellOf(lo.x - Particle::radius);
+    int y0 = cells.cellOf(lo.y - Particle::radius);
+    int x1 = cells.cellOf(hi.x + Particle::radius);
+    int y1 = cells.cellOf(hi.y + Particle::radius);
+
+    // only the occupied cells of the blocks that exist, however far the view reaches
+    for (int b = 0; b < cells.blocks.size(); b++) {
+        const SparseGrid::Block& block = cells.blocks[b];
+        if (!block.occupied || block.origin.x > x1 || block.origin.y > y1 ||
+            block.origin.x + SparseGrid::BLOCK <= x0 || block.origin.y + SparseGrid::BLOCK <= y0)
+            continue;
+        for (int local = 0; local < SparseGrid::BLOCK * SparseGrid::BLOCK; local++) {
+            if (!(block.occupied >> local & 1)) continue;
+            int x = block.origin.x + local % SparseGrid::BLOCK;
+            int y = block.origin.y + local / SparseGrid::BLOCK;
+            if (x < x0 || x > x1 || y < y0 || y > y1) continue;
+            const std::vector <int>& cell = block.cells[local];
+            if (splat) {
+                int count = (int)cell.size();
+                glm::vec3 centroid = glm::vec3(0.0f);
+                glm::vec3 color = glm::vec3(0.0f);
+                for (int k = 0; k < count; k++) {
+                    centroid += view.pos(cell[k]);
+                    color += speedToColor(glm::length(view.velocity(cell[k])));
+                }
+                if (count >= Camera::splatCount &&
+                    liveCount(x - 1, y) && liveCount(x + 1, y) && liveCount(x, y - 1) && liveCount(x, y + 1)) {
+                    pushInstance(splats, centroid / (float)count, splatScale, color / (float)count);
+                    Particle::numSplats++;
+                    Particle::numVisible += count;
+                    continue;
+                }
+            }
+            for (int k = 0; k < cell.size(); k++) {
+                int i = cell[k];
+                pushInstance(Particle::instances, view.pos(i), view.scale(i), speedToColor(glm::length(view.velocity(i))));
+                Particle::numVisible++;
+            }
+        }
     }
+}
 
-    // predict positions for density calculations
-    for (int i = 0; i < particles.size(); ++i) {
-        Particle& p = particles[i];
-        p.predictedPos = p.pos + stepSize * p.velocity;
+void Particle::drawElements(int object_Location, int color_Location) {
+    Metrics::beginCpu(Metrics::CPU_UPLOAD);
+    float ppu = Camera::pixelsPerUnit();
+    float radiusPx = radius * ppu;
+    bool splat = Camera::lod && s_Radius * ppu < Camera::splatPixels;
+    float aspect = (float)Camera::width / (float)Camera::height;
+    float splatScale = 0.5f * std::sqrt(aspect * aspect + 1.0f) * s_Radius / radius;
+
+    instances.clear();
+    splats.clear();
+    numVisible = 0;
+    numSplats = 0;
+    // the SPH solver's own state once it has loaded the particles, filed in the cells when first drawn after a step
+    if (SphSolver<2, float>::loaded) {
+        SphSolver<2, float>::fileCells();
+        fillInstances(SphSolver<2, float>::View(), splat, splatScale);
     }
-    
-    // calculate densities
-    for (int i = 0; i < particles.size(); ++i) calcuateDensities(i);
-
-    // apply pressure force
-    for (int i = 0; i < particles.size(); ++i) {
-        Particle& p = particles[i];
-        float dens = std::max(particles[i].density, 1e-4f);
-        p.acceleration = pressure(i) / dens;
-        p.acceleration.y -= 200.0f;
-        p.velocity += stepSize * p.acceleration;
-        float velMag = glm::length(p.velocity);
-        // velocity clamp
-        if (velMag > 15.0f) p.velocity = 15.0f * p.velocity / velMag;
+    else if (SphSolver<2, double>::loaded) {
+        SphSolver<2, double>::fileCells();
+        fillInstances(SphSolver<2, double>::View(), splat, splatScale);
     }
+    else fillInstances(ParticleView(), splat, splatScale);
+
+    int numParticles = (int)instances.size() / 6;
+    instances.insert(instances.end(), splats.begin(), splats.end());
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(float), instances.data(), GL_STREAM_DRAW);
+    Metrics::endCpu(Metrics::CPU_UPLOAD);
+
+    Metrics::beginCpu(Metrics::CPU_DRAW);
+    glUniform4f(object_Location, 0.0f, 0.0f, 0.0f, 0.0f);
+    glUniform3f(color_Location, 1.0f, 1.0f, 1.0f);
+
+    drawInstances(0, numParticles, radiusPx);
+    drawInstances(numParticles, numSplats, radiusPx * splatScale);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+    Metrics::endCpu(Metrics::CPU_DRAW);
 }
 
+void Particle::step() {
+    // the solver keeps its own two component state, drawing reads it, see SphSolver::View
+    if (doublePrecision)
+        SphSolver<2, double>::step();
+    else
+        SphSolver<2, float>::step();
+}
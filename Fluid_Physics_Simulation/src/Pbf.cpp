@@ -0,0 +1,134 @@
+#include "../HeaderFiles/Pbf.h"
+
+//Defining static members
+std::vector <float> Pbf::lambdas;
+std::vector <glm::vec3> Pbf::deltas;
+float Pbf::densityError = 0.0f;
+
+// scratch buffers reused between steps
+static std::vector <glm::vec3> previous;
+
+static void clampToBox(glm::vec3& pos) {
+    float r = Particle::radius;
+    pos.x = glm::clamp(pos.x, -0.9f + r, 0.9f - r);
+    pos.y = glm::clamp(pos.y, -0.9f + r, 0.9f - r);
+}
+
+// particles clamped into the same corner can end up on top of each other, push those apart sideways
+static glm::vec3 direction(int i, int j, const glm::vec3& offset, float dst) {
+    if (dst >= 1e-6f) return offset / dst;
+    return glm::vec3(i < j ? -1.0f : 1.0f, 0.0f, 0.0f);
+}
+
+void Pbf::solveDensity() {
+    // Jacobi iteration: every lambda is computed from the same positions, then every correction
+    // from the same lambdas, so each loop runs in parallel without coloring
+    std::vector <Particle>& particles = Particle::particles;
+    const std::vector <Span<int>>& neighbors = Particle::neighborLists;
+    int count = (int)particles.size();
+    float invRest = 1.0f / restDensity;
+    float error = 0.0f;
+
+#pragma omp parallel for schedule(dynamic, 64) reduction(+:error)
+    for (int i = 0; i < count; i++) {
+        float density = 0.0f;
+        float gradSum = 0.0f;
+        glm::vec3 gradSelf = glm::vec3(0.0f);
+        for (int k = 0; k < neighbors[i].size(); k++) {
+            int j = neighbors[i][k];
+            glm::vec3 offset = particles[i].pos - particles[j].pos;
+            float dst = glm::length(offset);
+            density += Particle::densityKernel(dst);
+            glm::vec3 grad = Particle::pressureKernel(dst) * invRest * direction(i, j, offset, dst);
+            gradSelf += grad;
+            gradSum += glm::dot(grad, grad);
+        }
+        gradSum += glm::dot(gradSelf, gradSelf);
+
+        // only compression is corrected, stretched particles at the surface are left alone
+        float constraint = std::max(density * invRest - 1.0f, 0.0f);
+        particles[i].density = density;
+        lambdas[i] = -constraint / (gradSum + relaxation);
+        error += constraint;
+    }
+    densityError = count > 0 ? error / count : 0.0f;
+
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < count; i++) {
+        glm::vec3 delta = glm::vec3(0.0f);
+        for (int k = 0; k < neighbors[i].size(); k++) {
+            int j = neighbors[i][k];
+            glm::vec3 offset = particles[i].pos - particles[j].pos;
+            float dst = glm::length(offset);
+            delta += (lambdas[i] + lambdas[j]) * Particle::pressureKernel(dst) * direction(i, j, offset, dst);
+        }
+        deltas[i] = delta * invRest;
+    }
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) {
+        particles[i].pos += deltas[i];
+        clampToBox(particles[i].pos);
+    }
+}
+
+void Pbf::step() {
+    std::vector <Particle>& particles = Particle::particles;
+    int count = (int)particles.size();
+    float dt = stepSize;
+    previous.resize(count);
+    lambdas.resize(count);
+    deltas.resize(count);
+
+    // apply gravity and predict positions, the cell maps are not safe to update concurrently
+    for (int i = 0; i < count; ++i) {
+        Particle& p = particles[i];
+        previous[i] = p.pos;
+        p.velocity.y -= 200.0f * dt;
+        p.pos += dt * p.velocity;
+        clampToBox(p.pos);
+        Particle::updateCell(i);
+    }
+
+    // gathered once per step, the iterations only move particles a fraction of the smoothing radius
+    Particle::gatherNeighbors();
+    for (int k = 0; k < iterations; k++) solveDensity();
+
+    // velocities follow from how far the particles actually moved
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) {
+        Particle& p = particles[i];
+        p.velocity = (p.pos - previous[i]) / dt;
+        p.predictedPos = p.pos;
+    }
+
+    const std::vector <Span<int>>& neighbors = Particle::neighborLists;
+    // XSPH: blend every velocity a little towards its neighbors' to damp noise from the solve
+    float blend = xsph / restDensity;
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < count; i++) {
+        glm::vec3 smooth = glm::vec3(0.0f);
+        for (int k = 0; k < neighbors[i].size(); k++) {
+            const Particle& n = particles[neighbors[i][k]];
+            smooth += (n.velocity - particles[i].velocity) * Particle::densityKernel(glm::length(n.pos - particles[i].pos));
+        }
+        deltas[i] = smooth * blend;
+    }
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) {
+        Particle& p = particles[i];
+        p.velocity += deltas[i];
+        float velMag = glm::length(p.velocity);
+        // velocity clamp
+        if (velMag > 15.0f) p.velocity = 15.0f * p.velocity / velMag;
+    }
+
+    // the iterations moved the particles on from the cells they were filed under
+    for (int i = 0; i < count; ++i) Particle::updateCell(i);
+
+    Particle::dt = dt;
+    Particle::dtLimit = "fixed";
+    Particle::simulatedTime += dt;
+    Particle::numSteps++;
+}
@@ -1,4 +1,6 @@
 #include"../HeaderFiles/Shaders.h"
+#include <cstring>
+#include <iterator>
 
 struct shaderProgramSource
 {
@@ -6,31 +8,49 @@ struct shaderProgramSource
     std::string fragmentSource;
 };
 
+const char* Shader::basicSource =
+#include "Basic.shader.inl"
+;
+
+bool Shader::cacheHit = false;
+
     Shader::shaderProgramSource Shader::parse(const std::string filePath) {
-    std::ifstream stream(filePath);
+    std::ifstream stream(filePath, std::ios::binary);
+    std::string source((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    return split(source);
+}
 
+    Shader::shaderProgramSource Shader::split(const std::string& source) {
     enum class shaderType
     {
         NONE = -1, VERTEX = 0, FRAGMENT = 1
     };
 
-    std::string line;
-    std::stringstream ss[2];
+    // cut the source at its "#shader" lines without copying it line by line
+    std::string out[2];
     shaderType type = shaderType::NONE;
+    size_t pos = 0;
+    while (pos < source.size()) {
+        size_t end = source.find('\n', pos);
+        if (end == std::string::npos) end = source.size();
 
-    while (getline(stream, line)) {
-        if (line.find("#shader") != std::string::npos) {
-            if (line.find("vertex") != std::string::npos)
+        size_t tag = source.find("#shader", pos);
+        if (tag < end) {
+            size_t vertex = source.find("vertex", tag);
+            size_t fragment = source.find("fragment", tag);
+            if (vertex < end)
                 type = shaderType::VERTEX;
-            else if (line.find("fragment") != std::string::npos)
+            else if (fragment < end)
                 type = shaderType::FRAGMENT;
         }
-        else {
-            ss[(int)type] << line << '\n';
+        else if (type != shaderType::NONE) {
+            out[(int)type].append(source, pos, end - pos);
+            out[(int)type] += '\n';
         }
+        pos = end + 1;
     }
 
-    return { ss[0].str(), ss[1].str() };
+    return { out[0], out[1] };
 }
 
     unsigned int Shader::compile(unsigned int type, const std::string& source) {
@@ -46,7 +66,7 @@ struct shaderProgramSource
         glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
         char* message = (char*)malloc(length * sizeof(char));
         glGetShaderInfoLog(id, length, &length, message);
-        std::cout << "Failed to compile " << (type == GL_VERTEX_SHADER ? "vertex" : "fragment") << " shader!" << std::endl;
+        std::cout << "Failed to compile " << (type == GL_VERTEX_SHADER ? "vertex" : type == GL_COMPUTE_SHADER ? "compute" : "fragment") << " shader!" << std::endl;
         std::cout << message << std::endl;
         glDeleteShader(id);
         return 0;
@@ -56,7 +76,7 @@ struct shaderProgramSource
     return id;
 }
 
-    unsigned int Shader::create(const std::string& vertexShader, const std::string& fragmentShader)
+    unsigned int Shader::create(const std::string& vertexShader, const std::string& fragmentShader, bool retrievable)
 {
     unsigned int program = glCreateProgram();
     unsigned int vs = compile(GL_VERTEX_SHADER, vertexShader);
@@ -64,6 +84,7 @@ struct shaderProgramSource
 
     glAttachShader(program, vs);
     glAttachShader(program, fs);
+    if (retrievable) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
     glValidateProgram(program);
 
@@ -71,4 +92,93 @@ struct shaderProgramSource
     glDeleteShader(fs);
 
     return program;
-};
\ No newline at end of file
+};
+
+    unsigned int Shader::createCompute(const std::string& computeShader)
+{
+    unsigned int cs = compile(GL_COMPUTE_SHADER, computeShader);
+    if (cs == 0) return 0;
+
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, cs);
+    glLinkProgram(program);
+    glDeleteShader(cs);
+
+    int linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked == GL_FALSE) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// FNV-1a, enough to tell drivers and shader sources apart
+static unsigned long long hashString(unsigned long long hash, const std::string& text) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+struct programCacheHeader
+{
+    char magic[4];
+    unsigned long long key;
+    unsigned int format;
+    unsigned int length;
+};
+
+    unsigned int Shader::load(const shaderProgramSource& source, const std::string& cachePath)
+{
+    cacheHit = false;
+    int numFormats = 0;
+    if (GLEW_ARB_get_program_binary) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    if (numFormats == 0) return create(source.vertexSource, source.fragmentSource);
+
+    // a binary is only valid for the driver that produced it
+    unsigned long long key = 14695981039346656037ull;
+    key = hashString(key, (const char*)glGetString(GL_VENDOR));
+    key = hashString(key, (const char*)glGetString(GL_RENDERER));
+    key = hashString(key, (const char*)glGetString(GL_VERSION));
+    key = hashString(key, source.vertexSource);
+    key = hashString(key, source.fragmentSource);
+
+    std::ifstream in(cachePath, std::ios::binary);
+    programCacheHeader header = {};
+    if (in.read((char*)&header, sizeof(header)) && memcmp(header.magic, "FPSB", 4) == 0 && header.key == key) {
+        std::string binary(header.length, '\0');
+        if (in.read(&binary[0], header.length)) {
+            unsigned int program = glCreateProgram();
+            glProgramBinary(program, header.format, binary.data(), header.length);
+            int linked = GL_FALSE;
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+            if (linked == GL_TRUE) {
+                cacheHit = true;
+                return program;
+            }
+            // driver rejected it (e.g. updated in place), fall back to source
+            glDeleteProgram(program);
+        }
+    }
+    in.close();
+
+    unsigned int program = create(source.vertexSource, source.fragmentSource, true);
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length > 0) {
+        std::string binary(length, '\0');
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, &binary[0]);
+
+        std::ofstream out(cachePath, std::ios::binary);
+        memcpy(header.magic, "FPSB", 4);
+        header.key = key;
+        header.format = format;
+        header.length = (unsigned int)length;
+        out.write((const char*)&header, sizeof(header));
+        out.write(binary.data(), length);
+    }
+    return program;
+}
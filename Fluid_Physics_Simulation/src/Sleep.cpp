@@ -0,0 +1,111 @@
+#include "../HeaderFiles/Sleep.h"
+#include "../HeaderFiles/SphSolver.h"
+#include "../HeaderFiles/Obstacles.h"
+
+// a cell of the solver's grid, carried over from the occupied cells of one sort to the next by key
+struct CellState
+{
+    unsigned long long key;
+    int quietSteps;
+    int count;          // particles in it last step
+    float density;      // mean density of its particles last step
+    float speed;        // fastest awake particle in it
+    bool asleep;
+    bool wake;
+};
+
+// the last sort's cells in key order, and this one's, swapped so that both keep their capacity
+static std::vector <CellState> cellStates;
+static std::vector <CellState> lastStates;
+static double lastCellSize = 0.0;
+static int lastReach = 0;
+
+template <int D, typename T>
+void Sleep::update() {
+    typedef SphSolver<D, T> Solver;
+    typedef typename Solver::State State;
+    typedef typename Solver::vec vec;
+    std::vector <State>& particles = Solver::particles;
+    int count = (int)particles.size();
+    int cells = (int)Solver::cellKeys.size();
+
+    // a cell that was empty last step starts with no history, and every cell when the grid was rebuilt
+    cellStates.swap(lastStates);
+    if ((double)Solver::cellSize != lastCellSize || Solver::reach != lastReach) {
+        lastStates.clear();
+        lastCellSize = (double)Solver::cellSize;
+        lastReach = Solver::reach;
+    }
+    cellStates.reserve(particles.capacity());
+    cellStates.resize(cells);
+    for (int c = 0, last = 0; c < cells; c++) {
+        unsigned long long key = Solver::cellKeys[c];
+        while (last < lastStates.size() && lastStates[last].key < key) last++;
+        if (last < lastStates.size() && lastStates[last].key == key) cellStates[c] = lastStates[last];
+        else {
+            CellState fresh = { key, 0, 0, 0.0f, 0.0f, false, false };
+            cellStates[c] = fresh;
+        }
+    }
+    float densityLimit = densityChange * (float)Solver::targetDensity;
+
+    // how quiet each cell was this step, from its awake particles
+#pragma omp parallel for schedule(static)
+    for (int c = 0; c < cells; c++) {
+        int first = Solver::cellStart[c];
+        int n = Solver::cellStart[c + 1] - first;
+        float fastest = 0.0f;
+        float density = 0.0f;
+        for (int k = first; k < first + n; k++) {
+            const State& p = particles[Solver::sorted[k]];
+            density += (float)p.density;
+            if (!p.asleep) fastest = std::max(fastest, (float)glm::length(p.velocity));
+        }
+        density = density / n;
+        // a particle entering or leaving wakes the cell
+        CellState& cell = cellStates[c];
+        cell.wake = n != cell.count;
+        bool quiet = !cell.wake && fastest < sleepSpeed && std::abs(density - cell.density) < densityLimit;
+        cell.quietSteps = quiet ? cell.quietSteps + 1 : 0;
+        cell.speed = fastest;
+        cell.count = n;
+        cell.density = density;
+    }
+
+    // the cells around that could reach into this one, as far as the largest smoothing length goes
+    int reach = std::max(Solver::reach, 1);
+    int reachZ = D == 3 ? reach : 0;
+#pragma omp parallel for schedule(static)
+    for (int c = 0; c < cells; c++) {
+        // a cell neither quiet nor asleep stays as it is whatever its neighbors do
+        CellState& cell = cellStates[c];
+        if (cell.quietSteps == 0 && !cell.asleep) continue;
+        bool stirred = cell.wake;
+        for (int dz = -reachZ; dz <= reachZ && !stirred; dz++) {
+            for (int dy = -reach; dy <= reach && !stirred; dy++) {
+                for (int dx = -reach; dx <= reach; dx++) {
+                    // across a periodic edge, the cell a period away
+                    glm::ivec3 coord = Solver::cellCoords[c] + glm::ivec3(dx, dy, dz);
+                    vec shift = vec(T(0));
+                    Solver::wrapCell(coord, shift);
+                    int n = Solver::findCell(coord, shift);
+                    if ((n >= 0 && cellStates[n].speed > wakeSpeed) || (Obstacles::enabled && Obstacles::covers(glm::ivec2(coord)))) {
+                        stirred = true;
+                        break;
+                    }
+                }
+            }
+        }
+        if (stirred) cell.asleep = false, cell.quietSteps = 0;
+        else if (cell.quietSteps >= sleepSteps) cell.asleep = true;
+    }
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++)
+        if (particles[i].alive) particles[i].asleep = cellStates[Solver::particleCell[i]].asleep;
+}
+
+template void Sleep::update<2, float>();
+template void Sleep::update<3, float>();
+template void Sleep::update<2, double>();
+template void Sleep::update<3, double>();
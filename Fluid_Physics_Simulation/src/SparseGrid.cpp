@@ -0,0 +1,156 @@
+#include "../HeaderFiles/SparseGrid.h"
+#include <climits>
+#include <algorithm>
+
+// returned for cells without a block
+static const std::vector <int> empty;
+
+void SparseGrid::reset(float size, int capacity) {
+    // every block freed for reuse, with its cells' capacity; cells of the same size keep what they
+    // have grown to, so a rebuild after reindexing does not start the doubling over
+    cellCapacity = size == cellSize ? std::max(capacity, cellCapacity) : capacity;
+    cellSize = size;
+    freeBlocks.clear();
+    for (int b = (int)blocks.size() - 1; b >= 0; b--) {
+        for (int c = 0; c < BLOCK * BLOCK; c++) {
+            blocks[b].cells[c].clear();
+            blocks[b].cells[c].reserve(cellCapacity);
+        }
+        blocks[b].occupied = 0;
+        freeBlocks.push_back(b);
+    }
+    for (int k = 0; k < blockIndex.size(); k++) blockIndex[k].block = -1;
+    numFiled = 0;
+    filed.clear();
+}
+
+int SparseGrid::find(unsigned long long k) const {
+    if (blockIndex.empty()) return -1;
+    int mask = (int)blockIndex.size() - 1;
+    for (int i = home(k); blockIndex[i].block >= 0; i = (i + 1) & mask)
+        if (blockIndex[i].key == k) return blockIndex[i].block;
+    return -1;
+}
+
+void SparseGrid::file(unsigned long long k, int b) {
+    if (2 * (numFiled + 1) > (int)blockIndex.size()) {
+        // doubled and refiled, the only time the index allocates
+        std::vector <Slot> old;
+        old.swap(blockIndex);
+        Slot none = { 0, -1 };
+        blockIndex.assign(std::max(2 * (int)old.size(), 64), none);
+        numFiled = 0;
+        for (int i = 0; i < old.size(); i++)
+            if (old[i].block >= 0) file(old[i].key, old[i].block);
+    }
+    int mask = (int)blockIndex.size() - 1;
+    int i = home(k);
+    while (blockIndex[i].block >= 0) i = (i + 1) & mask;
+    blockIndex[i].key = k;
+    blockIndex[i].block = b;
+    numFiled++;
+}
+
+void SparseGrid::unfile(unsigned long long k) {
+    int mask = (int)blockIndex.size() - 1;
+    int i = home(k);
+    while (blockIndex[i].key != k || blockIndex[i].block < 0) i = (i + 1) & mask;
+    // the slots after it that would no longer be reached from their home shift back into the gap
+    for (int j = (i + 1) & mask; blockIndex[j].block >= 0; j = (j + 1) & mask) {
+        int h = home(blockIndex[j].key);
+        bool between = i <= j ? (i < h && h <= j) : (i < h || h <= j);
+        if (between) continue;
+        blockIndex[i] = blockIndex[j];
+        i = j;
+    }
+    blockIndex[i].block = -1;
+    numFiled--;
+}
+
+std::vector <int>& SparseGrid::add(int x, int y) {
+    int bx = blockOf(x), by = blockOf(y);
+    int b = find(key(bx, by));
+    if (b < 0) {
+        // a freed block keeps its cells' capacity
+        if (!freeBlocks.empty()) b = freeBlocks.back(), freeBlocks.pop_back();
+        else {
+            b = (int)blocks.size();
+            blocks.push_back(Block());
+            for (int c = 0; c < BLOCK * BLOCK; c++) blocks[b].cells[c].reserve(cellCapacity);
+            // every block can be freed at once
+            freeBlocks.reserve(blocks.capacity());
+        }
+        blocks[b].origin = glm::ivec2(bx, by) * (int)BLOCK;
+        blocks[b].occupied = 0;
+        file(key(bx, by), b);
+    }
+    Block& block = blocks[b];
+    int local = (x - block.origin.x) + BLOCK * (y - block.origin.y);
+    block.occupied |= 1ull << local;
+    return block.cells[local];
+}
+
+void SparseGrid::grow(std::vector <int>& cell) {
+    // twice the most the fluid has packed into a cell so far, for this cell and for the cells of new
+    // blocks and of the next reset; the other cells keep what they have until they fill up themselves
+    cellCapacity = std::max(cellCapacity, 2 * (int)cell.size());
+    cell.reserve(cellCapacity);
+}
+
+void SparseGrid::remove(int index, int x, int y) {
+    int bx = blockOf(x), by = blockOf(y);
+    int b = find(key(bx, by));
+    if (b < 0) return;
+    Block& block = blocks[b];
+    int local = (x - block.origin.x) + BLOCK * (y - block.origin.y);
+    std::vector <int>& cell = block.cells[local];
+    for (int k = 0; k < cell.size(); k++) {
+        if (cell[k] != index) continue;
+        cell[k] = cell.back();
+        cell.pop_back();
+        break;
+    }
+    if (!cell.empty()) return;
+    block.occupied &= ~(1ull << local);
+    if (block.occupied) return;
+    freeBlocks.push_back(b);
+    unfile(key(bx, by));
+}
+
+void SparseGrid::insert(int index, glm::vec2 pos) {
+    glm::ivec2 c(cellOf(pos.x), cellOf(pos.y));
+    if (index >= filed.size()) filed.resize(index + 1, glm::ivec2(INT_MIN));
+    else if (filed[index].x != INT_MIN) remove(index, filed[index].x, filed[index].y);
+    filed[index] = c;
+    std::vector <int>& cell = add(c.x, c.y);
+    if (cell.size() == cell.capacity()) grow(cell);
+    cell.push_back(index);
+}
+
+void SparseGrid::move(int index, glm::vec2 pos) {
+    glm::ivec2 c(cellOf(pos.x), cellOf(pos.y));
+    if (index < filed.size() && filed[index] == c) return;
+    insert(index, pos);
+}
+
+void SparseGrid::erase(int index) {
+    if (index >= filed.size() || filed[index].x == INT_MIN) return;
+    remove(index, filed[index].x, filed[index].y);
+    filed[index] = glm::ivec2(INT_MIN);
+}
+
+const std::vector <int>& SparseGrid::cell(int x, int y) const {
+    int bx = blockOf(x), by = blockOf(y);
+    int b = find(key(bx, by));
+    if (b < 0) return empty;
+    const Block& block = blocks[b];
+    return block.cells[(x - block.origin.x) + BLOCK * (y - block.origin.y)];
+}
+
+size_t SparseGrid::footprint() const {
+    size_t bytes = blocks.capacity() * sizeof(Block) + freeBlocks.capacity() * sizeof(int)
+        + blockIndex.capacity() * sizeof(Slot) + filed.capacity() * sizeof(glm::ivec2);
+    for (int b = 0; b < blocks.size(); b++)
+        for (int c = 0; c < BLOCK * BLOCK; c++) bytes += blocks[b].cells[c].capacity() * sizeof(int);
+    return bytes;
+}
@@ -0,0 +1,159 @@
+#include "../HeaderFiles/Sph3d.h"
+#include "../HeaderFiles/Shaders.h"
+#include "../HeaderFiles/SphSolver.h"
+#include <algorithm>
+
+//Defining static members
+bool Sph3d::enabled = false;
+unsigned int Sph3d::program = 0;
+unsigned int Sph3d::vao = 0;
+unsigned int Sph3d::vbo = 0;
+std::vector <float> Sph3d::vertices;
+
+static const char* pointsSource =
+#include "Points.shader.inl"
+;
+
+static int viewProjection_Location = -1;
+static int pointScale_Location = -1;
+static int sprite_Location = -1;
+
+int Sph3d::maxBlock() {
+    // the block is centred in x and z and hangs from the top in y, each particle a radius inside the walls
+    float radius = Particle::radius;
+    float spacing = Particle::spacing;
+    float step = 2 * radius + spacing;
+    float top = 0.9f - (spacing + radius);
+    int across = (int)(2.0f * (std::min(depth, 0.9f) - radius) / step);
+    int down = (int)((top + 0.9f - radius) / step) + 1;
+    return std::max(std::min(across, down), 1);
+}
+
+void Sph3d::populate() {
+    float radius = Particle::radius;
+    float spacing = Particle::spacing;
+    float step = 2 * radius + spacing;
+    float left = 0.0f - step * blockSize / 2.0f;
+    float top = 0.9f - (spacing + radius);
+    int count = blockSize * blockSize * blockSize;
+
+    std::vector <Particle>& particles = Particle::particles;
+    particles.resize(count);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) {
+        Particle& p = particles[i];
+        int x = i % blockSize;
+        int y = (i / blockSize) % blockSize;
+        int z = i / (blockSize * blockSize);
+        p.pos = glm::vec3(left + x * step, top - y * step, left + z * step);
+        p.predictedPos = p.pos;
+        p.velocity = glm::vec3(0.0f);
+        p.acceleration = glm::vec3(0.0f);
+        p.viscosityRate = 0.0f;
+        p.density = 0.0f;
+        p.nearDensity = 0.0f;
+        p.scale = 1.0f;
+    }
+}
+
+void Sph3d::step() {
+    if (Particle::doublePrecision)
+        SphSolver<3, double>::step();
+    else
+        SphSolver<3, float>::step();
+}
+
+bool Sph3d::initRenderer() {
+    Shader::shaderProgramSource source = Shader::split(pointsSource);
+    program = Shader::create(source.vertexSource, source.fragmentSource);
+    if (program == 0) return false;
+    viewProjection_Location = glGetUniformLocation(program, "u_ViewProjection");
+    pointScale_Location = glGetUniformLocation(program, "u_PointScale");
+    sprite_Location = glGetUniformLocation(program, "u_Sprite");
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 7, 0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 7, (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(float) * 7, (void*)(6 * sizeof(float)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    // compatibility contexts only fill gl_PointCoord for sprites
+    glEnable(GL_POINT_SPRITE);
+    glGetError();
+
+    Camera::orbit = true;
+    return true;
+}
+
+template <typename View>
+static void fillVertices(const View& view) {
+    int count = view.count();
+    Sph3d::vertices.resize(count * 7);
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) {
+        glm::vec3 pos = view.pos(i);
+        glm::vec3 color = speedToColor(glm::length(view.velocity(i)));
+        float* v = &Sph3d::vertices[i * 7];
+        v[0] = pos.x;
+        v[1] = pos.y;
+        v[2] = pos.z;
+        v[3] = color.r;
+        v[4] = color.g;
+        v[5] = color.b;
+        v[6] = view.scale(i);
+    }
+}
+
+void Sph3d::drawElements() {
+    Metrics::beginCpu(Metrics::CPU_UPLOAD);
+    // the solver's own state once it has loaded the particles
+    if (SphSolver<3, float>::loaded) fillVertices(SphSolver<3, float>::View());
+    else if (SphSolver<3, double>::loaded) fillVertices(SphSolver<3, double>::View());
+    else fillVertices(ParticleView());
+    int count = (int)vertices.size() / 7;
+
+    // the twelve edges of the tank, white
+    float d = depth;
+    const float corners[8][3] = {
+        { -0.9f, -0.9f, -d }, { 0.9f, -0.9f, -d }, { 0.9f, 0.9f, -d }, { -0.9f, 0.9f, -d },
+        { -0.9f, -0.9f,  d }, { 0.9f, -0.9f,  d }, { 0.9f, 0.9f,  d }, { -0.9f, 0.9f,  d }
+    };
+    const int edges[24] = { 0,1, 1,2, 2,3, 3,0, 4,5, 5,6, 6,7, 7,4, 0,4, 1,5, 2,6, 3,7 };
+    for (int e = 0; e < 24; e++) {
+        const float* c = corners[edges[e]];
+        vertices.insert(vertices.end(), { c[0], c[1], c[2], 1.0f, 1.0f, 1.0f, 1.0f });
+    }
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STREAM_DRAW);
+    Metrics::endCpu(Metrics::CPU_UPLOAD);
+
+    Metrics::beginCpu(Metrics::CPU_DRAW);
+    glm::mat4 projection = Camera::projection();
+    glm::mat4 viewProjection = projection * Camera::view();
+    glUseProgram(program);
+    glUniformMatrix4fv(viewProjection_Location, 1, GL_FALSE, glm::value_ptr(viewProjection));
+    glUniform1f(pointScale_Location, Particle::radius * projection[1][1] * Camera::height);
+
+    glUniform1i(sprite_Location, 0);
+    glDrawArrays(GL_LINES, count, 24);
+    glUniform1i(sprite_Location, 1);
+    glDrawArrays(GL_POINTS, 0, count);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    Particle::numVisible = count;
+    Particle::numSplats = 0;
+    Metrics::endCpu(Metrics::CPU_DRAW);
+}
@@ -0,0 +1,1602 @@
+#include "../HeaderFiles/SphSolver.h"
+#include "../HeaderFiles/Sph3d.h"
+#include "../HeaderFiles/Multires.h"
+#include "../HeaderFiles/Sleep.h"
+#include "../HeaderFiles/Metrics.h"
+#include "../HeaderFiles/Arena.h"
+#include "../HeaderFiles/Container.h"
+#include "../HeaderFiles/Obstacles.h"
+#include "../HeaderFiles/Emitters.h"
+#include <xmmintrin.h>
+#include <cstring>
+#include <cstring>
+#include <algorithm>
+#include <climits>
+
+//Defining static members
+template <int D, typename T> std::vector <typename SphSolver<D, T>::State> SphSolver<D, T>::particles;
+template <int D, typename T> T SphSolver<D, T>::cellSize = T(0);
+template <int D, typename T> typename SphSolver<D, T>::vec SphSolver<D, T>::cellWidth;
+template <int D, typename T> T SphSolver<D, T>::maxSmoothing = T(0);
+template <int D, typename T> T SphSolver<D, T>::maxDrift = T(0);
+template <int D, typename T> int SphSolver<D, T>::reach = 0;
+template <int D, typename T> glm::ivec3 SphSolver<D, T>::period = glm::ivec3(0);
+template <int D, typename T> typename SphSolver<D, T>::CellBlock SphSolver<D, T>::uniformBlock;
+template <int D, typename T> std::vector <typename SphSolver<D, T>::Run> SphSolver<D, T>::runs;
+template <int D, typename T> std::vector <unsigned long long> SphSolver<D, T>::cellKeys;
+template <int D, typename T> std::vector <glm::ivec3> SphSolver<D, T>::cellCoords;
+template <int D, typename T> std::vector <int> SphSolver<D, T>::cellStart;
+template <int D, typename T> std::vector <int> SphSolver<D, T>::rowStart;
+template <int D, typename T> std::vector <int> SphSolver<D, T>::sorted;
+template <int D, typename T> std::vector <int> SphSolver<D, T>::particleCell;
+template <int D, typename T> std::vector <typename SphSolver<D, T>::Range> SphSolver<D, T>::neighborRanges;
+template <int D, typename T> std::vector <typename SphSolver<D, T>::vec> SphSolver<D, T>::neighborShifts;
+template <int D, typename T> std::vector <unsigned long long> SphSolver<D, T>::tableKeys;
+template <int D, typename T> std::vector <int> SphSolver<D, T>::tableCells;
+template <int D, typename T> typename SphSolver<D, T>::vec SphSolver<D, T>::lower;
+template <int D, typename T> typename SphSolver<D, T>::vec SphSolver<D, T>::upper;
+template <int D, typename T> T SphSolver<D, T>::targetDensity = T(0);
+template <int D, typename T> int SphSolver<D, T>::substep = 0;
+template <int D, typename T> T SphSolver<D, T>::tightest = T(0);
+template <int D, typename T> T SphSolver<D, T>::heldStep = T(0);
+template <int D, typename T> bool SphSolver<D, T>::loaded = false;
+template <int D, typename T> bool SphSolver<D, T>::filed = false;
+template <int D, typename T> bool SphSolver<D, T>::reindexed = false;
+
+static const double PI = 3.1415926535897932384626433832;
+
+// a free slot of the cell table
+static const unsigned long long NO_KEY = ~0ull;
+
+// the tiles' lists take squared distances up to this much past the squared reach, wide enough for the
+// rounding of the sums' own tests
+static const double TILE_MARGIN = 1.0001;
+
+// kernel scales for the smoothing radius, normalised in D dimensions
+template <int D, typename T>
+struct Kernels
+{
+    T h;
+    T density;      // poly6
+    T pressure;     // spiky gradient
+    T viscosity;    // viscosity laplacian
+    T near;         // near pressure gradient
+
+    Kernels() : Kernels((T)Particle::s_Radius) {}
+
+    explicit Kernels(T radius) {
+        double r = radius;
+        h = radius;
+        density   = (T)(D == 2 ? 4.0 / (PI * std::pow(r, 8.0)) : 315.0 / (64.0 * PI * std::pow(r, 9.0)));
+        pressure  = (T)(D == 2 ? -30.0 / (PI * std::pow(r, 5.0)) : -45.0 / (PI * std::pow(r, 6.0)));
+        viscosity = (T)(D == 2 ? 40.0 / (PI * std::pow(r, 5.0)) : 45.0 / (PI * std::pow(r, 6.0)));
+        near      = (T)(-3.0 / r);
+    }
+
+    // the same kernels for another smoothing length, from powers of the ratio instead of pow
+    Kernels scaled(T radius) const {
+        Kernels k = *this;
+        T ratio = h / radius;
+        T ratio2 = ratio * ratio;
+        T ratioD = D == 2 ? ratio2 : ratio2 * ratio;
+        T ratioD3 = ratioD * ratio2 * ratio;          // h^-(D + 3)
+        k.h = radius;
+        k.density = density * ratioD3 * ratio2 * ratio;
+        k.pressure = pressure * ratioD3;
+        k.viscosity = viscosity * ratioD3;
+        k.near = near * ratio;
+        return k;
+    }
+};
+
+// 1 / sqrt(x) from the SSE estimate (12 bits) and one Newton step (about 22 bits), for +fastmath
+template <typename T>
+static T rsqrt(T x) {
+    T y = (T)_mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss((float)x)));
+    return y * (T(1.5) - T(0.5) * x * y * y);
+}
+
+// the curl of two vectors as a 3D vector, along z in 2D
+template <typename T>
+static glm::vec<3, T> curl(const glm::vec<2, T>& a, const glm::vec<2, T>& b) {
+    return glm::vec<3, T>(T(0), T(0), a.x * b.y - a.y * b.x);
+}
+
+template <typename T>
+static glm::vec<3, T> curl(const glm::vec<3, T>& a, const glm::vec<3, T>& b) {
+    return glm::cross(a, b);
+}
+
+// fp16 halves for +compact, rounded to nearest even: below the smallest normal half is zero and past the
+// largest is the largest, neither of which the clamped velocities and the densities come near
+static unsigned short toHalf(float value) {
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    unsigned int sign = bits >> 16 & 0x8000;
+    int exponent = (int)(bits >> 23 & 0xff) - 127 + 15;
+    if (exponent <= 0) return (unsigned short)sign;
+    if (exponent >= 31) return (unsigned short)(sign | 0x7bff);
+    unsigned int mantissa = bits & 0x7fffff;
+    unsigned int half = (unsigned int)exponent << 10 | mantissa >> 13;
+    // a carry out of the mantissa moves the exponent on, which is still the nearest half
+    unsigned int rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+    return (unsigned short)(sign | std::min(half, 0x7bffu));
+}
+
+static float fromHalf(unsigned short half) {
+    unsigned int sign = (unsigned int)(half & 0x8000) << 16;
+    unsigned int rest = half & 0x7fff;
+    unsigned int bits = rest ? sign | (rest + ((127 - 15) << 10)) << 13 : sign;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// the ranges of the sort a particle's neighbors are in, in the order the sums have always taken them:
+// one per run of the uniform block around its cell, or one per occupied cell of a block of its own
+template <int D, typename T>
+struct CellWalk
+{
+    typedef SphSolver<D, T> Solver;
+    typedef typename Solver::vec vec;
+
+    int home;
+    const typename Solver::CellBlock* block;    // null for the uniform block
+    int run;
+    glm::ivec3 d;                               // the next cell of the block, x fastest
+
+    CellWalk(int home, const typename Solver::CellBlock* block)
+        : home(home), block(block), run(0), d(block ? block->lo : glm::ivec3(0)) {}
+
+    bool next(int& from, int& to, vec& shift) {
+        if (!block) {
+            int numRuns = (int)Solver::runs.size();
+            if (run == numRuns) return false;
+            int r = home * numRuns + run++;
+            from = Solver::neighborRanges[r].from;
+            to = Solver::neighborRanges[r].to;
+            shift = Solver::neighborShifts.empty() ? vec(T(0)) : Solver::neighborShifts[r];
+            return true;
+        }
+        const typename Solver::CellBlock& b = *block;
+        for (; d.z <= b.hi.z; d.z++, d.y = b.lo.y) {
+            for (; d.y <= b.hi.y; d.y++, d.x = b.lo.x) {
+                T gapYZ = b.gap[2][d.z - b.lo.z] + b.gap[1][d.y - b.lo.y];
+                while (d.x <= b.hi.x) {
+                    glm::ivec3 cell = d;
+                    d.x++;
+                    if (gapYZ + b.gap[0][cell.x - b.lo.x] >= b.range2) continue;
+                    shift = vec(T(0));
+                    int c = Solver::findCell(Solver::cellCoords[home] + cell, shift);
+                    if (c < 0) continue;
+                    from = Solver::cellStart[c];
+                    to = Solver::cellStart[c + 1];
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+};
+
+template <int D, typename T>
+void SphSolver<D, T>::load() {
+    const std::vector <Particle>& source = Particle::particles;
+    int count = (int)source.size();
+    // the pool's capacity up front, so that emission never reallocates
+    if (Emitters::enabled) {
+        particles.reserve(std::max(Emitters::capacity, count));
+        sorted.reserve(std::max(Emitters::capacity, count));
+        particleCell.reserve(std::max(Emitters::capacity, count));
+    }
+    particles.resize(count);
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) {
+        State& s = particles[i];
+        const Particle& p = source[i];
+        for (int k = 0; k < D; k++) {
+            s.pos[k] = (T)p.pos[k];
+            s.predictedPos[k] = (T)p.predictedPos[k];
+            s.velocity[k] = (T)p.velocity[k];
+            s.acceleration[k] = (T)p.acceleration[k];
+        }
+        s.density = (T)p.density;
+        s.nearDensity = (T)p.nearDensity;
+        s.viscosityRate = (T)p.viscosityRate;
+        s.h = (T)Particle::s_Radius * (T)p.scale;
+        s.mass = std::pow((T)p.scale, (T)D);
+        s.level = (int)std::lround(D * std::log2(p.scale));
+        s.vorticity = T(0);
+        s.surface = T(0);
+        s.age = 0;
+        s.asleep = false;
+        s.alive = true;
+        s.rung = 0;
+        s.neighborRung = 0;
+        s.elapsed = T(0);
+        s.opened = T(0);
+    }
+    substep = 0;
+    heldStep = T(0);
+    loaded = true;
+    // populate filed Particle's cells at these positions
+    filed = true;
+    reindexed = false;
+
+    // the 2D box, and the tank's depth in 3D
+    lower = vec(T(-0.9));
+    upper = vec(T(0.9));
+    targetDensity = (T)Particle::targetDensity;
+    if (D == 3) {
+        lower[D - 1] = (T)-Sph3d::depth;
+        upper[D - 1] = (T)Sph3d::depth;
+        targetDensity = (T)Sph3d::targetDensity;
+    }
+    // around the container's walls, which may reach past the box
+    if (D == 2 && Container::enabled) {
+        for (int k = 0; k < 2; k++) {
+            lower[k] = (T)Container::lower[k];
+            upper[k] = (T)Container::upper[k];
+        }
+    }
+    // sized to the smoothing lengths again on the next sort, the obstacles are binned before it
+    maxSmoothing = (T)Particle::s_Radius;
+    buildGrid((T)Particle::s_Radius, 1);
+}
+
+template <int D, typename T>
+void SphSolver<D, T>::buildGrid(T size, int rings) {
+    cellSize = size;
+    reach = rings;
+    period = glm::ivec3(0);
+    for (int k = 0; k < D; k++) {
+        // a whole number of cells per period, so that the wrapped cells line up
+        T length = upper[k] - lower[k];
+        if (periodic(k)) period[k] = std::max((int)std::floor(length / size + T(1e-4)), 1);
+        cellWidth[k] = periodic(k) ? length / (T)period[k] : size;
+    }
+
+    // the most runs the block can have, a row each or a cell each when x is periodic
+    int side = 2 * rings + 1;
+    runs.reserve(side * (D == 3 ? side : 1) * (periodic(0) ? side : 1));
+    buildRuns(T(0));
+}
+
+template <int D, typename T>
+void SphSolver<D, T>::buildRuns(T drift) {
+    // the block of every cell, as many rings as the cells divide the largest smoothing length, less the
+    // cells that no point of the home cell comes within that smoothing length of: the squared gap
+    // in cells between two cells d apart along an axis is that of |d| - 1 whole cells. The particles are
+    // sorted by their positions but the densities are summed at the predicted ones, so the gap has to
+    // cover the drift of both particles of a pair as well. A 2D block is the one layer z = 0, with no gap
+    int rings = reach;
+    int rings3 = D == 3 ? rings : 0;
+    uniformBlock.lo = glm::ivec3(-rings, -rings, -rings3);
+    uniformBlock.hi = glm::ivec3(rings, rings, rings3);
+    for (int k = 0; k < 3; k++) {
+        T scale = k < D ? cellWidth[k] / cellSize : T(0);
+        for (int d = -rings; d <= rings; d++) {
+            T g = (T)std::max(std::abs(d) - 1, 0) * scale;
+            uniformBlock.gap[k][d + rings] = g * g;
+        }
+    }
+    T range = (maxSmoothing + T(2) * drift) / cellSize;
+    uniformBlock.range2 = range * range;
+
+    // the rows of the block in the order the loops walk it, a row's cells within reach are contiguous
+    const CellBlock& b = uniformBlock;
+    runs.clear();
+    for (int z = b.lo.z; z <= b.hi.z; z++) {
+        for (int y = b.lo.y; y <= b.hi.y; y++) {
+            T gapYZ = b.gap[2][z - b.lo.z] + b.gap[1][y - b.lo.y];
+            for (int x = b.lo.x; x <= b.hi.x; x++) {
+                if (gapYZ + b.gap[0][x - b.lo.x] >= b.range2) continue;
+                bool extend = !periodic(0) && !runs.empty() && runs.back().first == glm::ivec3(x - runs.back().cells, y, z);
+                if (extend) runs.back().cells++;
+                else {
+                    Run r = { glm::ivec3(x, y, z), 1 };
+                    runs.push_back(r);
+                }
+            }
+        }
+    }
+}
+
+template <int D, typename T>
+const typename SphSolver<D, T>::CellBlock& SphSolver<D, T>::blockOf(const vec& pos, const glm::ivec3& home, T range, CellBlock& block) {
+    // in cells of cellSize, the stretched cells of periodic axes are scaled to them. Only the block's
+    // extent stops at the rings, the range keeps the margin for the drift
+    T r = range / cellSize;
+    block.range2 = r * r;
+    for (int k = 0; k < 3; k++) {
+        block.lo[k] = block.hi[k] = 0;
+        block.gap[k][0] = T(0);
+        if (k >= D) continue;
+        // position within the home cell, outside [0, 1) when it drifted out or was clamped to the last cell
+        // of a period or of the keys
+        T scale = cellWidth[k] / cellSize;
+        T u = (pos[k] - lower[k]) / cellWidth[k];
+        T f = u - (T)home[k];
+        block.lo[k] = std::max((int)std::floor(f - r / scale), -reach);
+        block.hi[k] = std::min((int)std::floor(f + r / scale), reach);
+        for (int d = block.lo[k]; d <= block.hi[k]; d++) {
+            T g = std::max(std::max((T)d - f, f - (T)d - T(1)), T(0)) * scale;
+            block.gap[k][d - block.lo[k]] = g * g;
+        }
+    }
+    return block;
+}
+
+template <typename State>
+static void copyOut(const State& s, Particle& p, int dimensions) {
+    for (int k = 0; k < dimensions; k++) {
+        p.pos[k] = (float)s.pos[k];
+        p.predictedPos[k] = (float)s.predictedPos[k];
+        p.velocity[k] = (float)s.velocity[k];
+        p.acceleration[k] = (float)s.acceleration[k];
+    }
+    p.density = (float)s.density;
+    p.nearDensity = (float)s.nearDensity;
+    p.viscosityRate = (float)s.viscosityRate;
+    p.scale = (float)s.h / Particle::s_Radius;
+}
+
+template <int D, typename T>
+void SphSolver<D, T>::store() {
+    if (!loaded) return;
+    std::vector <Particle>& target = Particle::particles;
+    int count = (int)particles.size();
+    target.resize(count);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) copyOut(particles[i], target[i], D);
+}
+
+template <int D, typename T>
+void SphSolver<D, T>::fileCells() {
+    // the 2D drawing and the surface walk Particle's cell map, which is not safe to update concurrently
+    if (D != 2 || filed) return;
+    filed = true;
+    int count = (int)particles.size();
+    if (reindexed || Particle::cells.cellSize != Particle::s_Radius) {
+        // Multires split or merged particles, or Emitters compacted them, or s_Radius changed
+        reindexed = false;
+        Particle::resetCells();
+        for (int i = 0; i < count; i++)
+            if (particles[i].alive) Particle::cells.insert(i, glm::vec2(widen(particles[i].pos)));
+        return;
+    }
+    // the sleeping ones too, they may have moved since the cells were last filed; dead slots left
+    // the cells when they died, the particles Emitters appended are filed like the moved ones
+    for (int i = 0; i < count; i++)
+        if (particles[i].alive) Particle::cells.move(i, glm::vec2(widen(particles[i].pos)));
+}
+
+template <int D, typename T>
+glm::ivec3 SphSolver<D, T>::coordOf(const vec& pos) {
+    // a periodic axis keeps a position that rounds onto its upper end in the last cell
+    glm::ivec3 coord(0);
+    for (int k = 0; k < D; k++) {
+        T first = periodic(k) ? T(0) : -(T)(1 << (KEY_BITS - 1));
+        T last = periodic(k) ? (T)(period[k] - 1) : (T)((1 << (KEY_BITS - 1)) - 1);
+        coord[k] = (int)glm::clamp(std::floor((pos[k] - lower[k]) / cellWidth[k]), first, last);
+    }
+    return coord;
+}
+
+template <int D, typename T>
+unsigned long long SphSolver<D, T>::keyOf(const glm::ivec3& coord) {
+    // x in the low bits, so that the keys sort row by row and a row's cells are contiguous
+    unsigned long long key = 0;
+    for (int k = 2; k >= 0; k--) {
+        int biased = glm::clamp(coord[k] + (1 << (KEY_BITS - 1)), 0, (1 << KEY_BITS) - 1);
+        key = key << KEY_BITS | (unsigned long long)biased;
+    }
+    return key;
+}
+
+template <int D, typename T>
+int SphSolver<D, T>::slotOf(unsigned long long key) {
+    // linear probing from the key's Fibonacci hash, to the key's slot or the free one it would take
+    int mask = (int)tableKeys.size() - 1;
+    int slot = (int)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    while (tableKeys[slot] != key && tableKeys[slot] != NO_KEY) slot = (slot + 1) & mask;
+    return slot;
+}
+
+template <int D, typename T>
+void SphSolver<D, T>::wrapCell(glm::ivec3& coord, vec& shift) {
+    for (int k = 0; k < D; k++) {
+        if (!periodic(k)) continue;
+        while (coord[k] < 0) coord[k] += period[k], shift[k] -= upper[k] - lower[k];
+        while (coord[k] >= period[k]) coord[k] -= period[k], shift[k] += upper[k] - lower[k];
+    }
+}
+
+template <int D, typename T>
+int SphSolver<D, T>::findCell(glm::ivec3 coord, vec& shift) {
+    if (tableKeys.empty()) return -1;
+    wrapCell(coord, shift);
+    int slot = slotOf(keyOf(coord));
+    return tableKeys[slot] == NO_KEY ? -1 : tableCells[slot];
+}
+
+template <int D, typename T>
+T SphSolver<D, T>::particleDensity() {
+    // the kernels are normalised, so with unit masses the density is the particles per unit volume
+    T sum = T(0);
+    int live = 0;
+    for (int i = 0; i < particles.size(); i++) {
+        if (!particles[i].alive) continue;
+        sum += particles[i].density;
+        live++;
+    }
+    if (live == 0) return T(0);
+    return sum / (T)live * (T)std::pow((T)Particle::s_Radius, (T)D);
+}
+
+template <int D, typename T>
+int SphSolver<D, T>::chooseDivisions() {
+    if (Particle::cellDivisions > 0) return std::min(Particle::cellDivisions, 3);
+    // A particle's neighbor loops at d cells per smoothing length cost the distance tests of the particles
+    // in its block, the particles per h^D by the last density pass times the block's volume in h^D, plus
+    // the start of a range for each row of the block, about RUN_COST tests each. The volume is that of the
+    // cells the gap test keeps, of (2d + 1)^D at (1/d)^D h^D each: in 2D all of them, 9, 6.25 and 5.4 h^2 in
+    // 3, 5 and 7 rows, in 3D 27, 15.6 and 11.5 h^3 (311 of the 343 cells) in 9, 25 and 49 rows. So h/2
+    // pays past 3.6 particles per h^2 and 7.0 per h^3, and h/3 past 12.4 and 29.
+    static const T RUN_COST = T(5);
+    T volume[4], rows[4];
+    for (int d = 1; d <= 3; d++) {
+        int cells = 0, numRows = 0;
+        int dz = D == 3 ? d : 0;
+        for (int z = -dz; z <= dz; z++) {
+            for (int y = -d; y <= d; y++) {
+                int kept = 0;
+                for (int x = -d; x <= d; x++) {
+                    int gx = std::max(std::abs(x) - 1, 0), gy = std::max(std::abs(y) - 1, 0), gz = std::max(std::abs(z) - 1, 0);
+                    if (gx * gx + gy * gy + gz * gz < d * d) kept++;
+                }
+                cells += kept;
+                numRows += kept > 0;
+            }
+        }
+        volume[d] = (T)cells / std::pow((T)d, (T)D);
+        rows[d] = (T)numRows;
+    }
+
+    T density = particleDensity();
+    int current = glm::clamp(reach, 1, 3);
+    if (density == T(0)) return current;
+    int best = 1;
+    for (int d = 2; d <= 3; d++)
+        if (density * volume[d] + RUN_COST * rows[d] < density * volume[best] + RUN_COST * rows[best]) best = d;
+    // finer cells have to win at a fifth less density and coarser ones at a fifth more, so that the grid
+    // is not rebuilt every step near a crossover
+    T margin = best > current ? T(1) / T(1.2) : T(1.2);
+    T density2 = density * margin;
+    return density2 * volume[best] + RUN_COST * rows[best] < density2 * volume[current] + RUN_COST * rows[current] ? best : current;
+}
+
+template <int D, typename T>
+int SphSolver<D, T>::countPairs(double& density, long long& candidates, long long& neighbors) {
+    density = (double)particleDensity();
+    candidates = 0;
+    neighbors = 0;
+    if (cellStart.empty()) return reach;
+    int cells = (int)cellKeys.size();
+    int numRuns = (int)runs.size();
+    bool wrap = !neighborShifts.empty();
+    T h2 = (T)Particle::s_Radius * (T)Particle::s_Radius;
+    for (int home = 0; home < cells; home++) {
+        for (int a = cellStart[home]; a < cellStart[home + 1]; a++) {
+            const vec& origin = particles[sorted[a]].pos;
+            for (int r = 0; r < numRuns; r++) {
+                const Range& range = neighborRanges[home * numRuns + r];
+                vec shift = wrap ? neighborShifts[home * numRuns + r] : vec(T(0));
+                candidates += range.to - range.from;
+                for (int k = range.from; k < range.to; k++) {
+                    vec offset = particles[sorted[k]].pos + shift - origin;
+                    if (k != a && glm::dot(offset, offset) < h2) neighbors++;
+                }
+            }
+            // itself
+            candidates--;
+        }
+    }
+    return reach;
+}
+
+template <int D, typename T>
+void SphSolver<D, T>::sortCells() {
+    int count = (int)particles.size();
+    T minSmoothing = (T)Particle::s_Radius;
+    maxSmoothing = minSmoothing;
+    if (Multires::enabled) {
+        for (int i = 0; i < count; i++) {
+            minSmoothing = std::min(minSmoothing, particles[i].h);
+            maxSmoothing = std::max(maxSmoothing, particles[i].h);
+        }
+    }
+    int rings = std::min((int)std::ceil(maxSmoothing / minSmoothing - T(1e-4)), (int)MAX_REACH);
+    if (!Multires::enabled) {
+        // cells of a fraction of the smoothing length, reached in as many rings
+        rings = chooseDivisions();
+        minSmoothing /= (T)rings;
+    }
+    if (minSmoothing != cellSize || rings != reach) buildGrid(minSmoothing, rings);
+
+    // the runs reach as far again as the predicted positions the densities are summed at have drifted
+    T drift2 = T(0);
+    for (int i = 0; i < count; i++) {
+        if (!particles[i].alive) continue;
+        vec drift = particles[i].predictedPos - particles[i].pos;
+        drift2 = std::max(drift2, glm::dot(drift, drift));
+    }
+    maxDrift = std::sqrt(drift2);
+    buildRuns(maxDrift);
+
+    // sized for the pool's capacity and the most runs up front, so that the cells never reallocate as the
+    // fluid spreads
+    int capacity = std::max((int)particles.capacity(), 1);
+    int numRuns = (int)runs.size();
+    int tableSize = 16;
+    while (tableSize < 2 * capacity) tableSize *= 2;
+    if (tableKeys.size() != tableSize) {
+        tableKeys.resize(tableSize);
+        tableCells.resize(tableSize);
+    }
+    cellKeys.reserve(capacity);
+    cellCoords.reserve(capacity);
+    cellStart.reserve(capacity + 1);
+    rowStart.reserve(capacity + 1);
+    neighborRanges.reserve(capacity * (int)runs.capacity());
+    if (Particle::periodic & ((1 << D) - 1)) neighborShifts.reserve(capacity * (int)runs.capacity());
+    sorted.resize(count);
+    particleCell.resize(count);
+
+    // every live particle's cell into the table, the cells numbered as they are first met
+    std::fill(tableKeys.begin(), tableKeys.end(), NO_KEY);
+    cellKeys.clear();
+    int* slots = Arena::local().alloc<int>(count);
+    for (int i = 0; i < count; i++) {
+        // dead slots of the Emitters pool are left out
+        slots[i] = -1;
+        if (!particles[i].alive) continue;
+        unsigned long long key = keyOf(coordOf(particles[i].pos));
+        int slot = slotOf(key);
+        if (tableKeys[slot] == NO_KEY) {
+            tableKeys[slot] = key;
+            tableCells[slot] = (int)cellKeys.size();
+            cellKeys.push_back(key);
+        }
+        slots[i] = slot;
+    }
+    // then renumbered in key order
+    std::sort(cellKeys.begin(), cellKeys.end());
+    int cells = (int)cellKeys.size();
+    cellCoords.resize(cells);
+    for (int c = 0; c < cells; c++) {
+        tableCells[slotOf(cellKeys[c])] = c;
+        for (int k = 0; k < 3; k++)
+            cellCoords[c][k] = (int)(cellKeys[c] >> (k * KEY_BITS) & ((1 << KEY_BITS) - 1)) - (1 << (KEY_BITS - 1));
+    }
+
+    // counting sort, the prefix sum makes this serial but it is a single pass over the particles
+    cellStart.assign(cells + 1, 0);
+    for (int i = 0; i < count; i++) {
+        particleCell[i] = slots[i] >= 0 ? tableCells[slots[i]] : -1;
+        if (particleCell[i] >= 0) cellStart[particleCell[i] + 1]++;
+    }
+    for (int c = 0; c < cells; c++) cellStart[c + 1] += cellStart[c];
+    int* cursor = Arena::local().alloc<int>(cells);
+    std::copy(cellStart.begin(), cellStart.end() - 1, cursor);
+    for (int i = 0; i < count; i++)
+        if (particleCell[i] >= 0) sorted[cursor[particleCell[i]]++] = i;
+
+    // the range of each run around every cell: the occupied cells of a row are contiguous in key order
+    // and go along x, so a search finds each neighbor row once and the row's cells sweep it
+    bool wrap = (Particle::periodic & ((1 << D) - 1)) != 0;
+    neighborRanges.resize(cells * numRuns);
+    neighborShifts.resize(wrap ? cells * numRuns : 0);
+    rowStart.clear();
+    for (int c = 0; c < cells; c++)
+        if (c == 0 || cellKeys[c] >> KEY_BITS != cellKeys[c - 1] >> KEY_BITS) rowStart.push_back(c);
+    int numRows = (int)rowStart.size();
+    rowStart.push_back(cells);
+    const int* rows = rowStart.data();
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int row = 0; row < numRows; row++) {
+        for (int r = 0; r < numRuns; r++) {
+            // the neighbor row, a period away across a periodic edge
+            glm::ivec3 coord = cellCoords[rows[row]] + glm::ivec3(0, runs[r].first.y, runs[r].first.z);
+            vec shift = vec(T(0));
+            wrapCell(coord, shift);
+            int begin = (int)(std::lower_bound(cellKeys.begin(), cellKeys.end(), keyOf(glm::ivec3(INT_MIN / 2, coord.y, coord.z))) - cellKeys.begin());
+            int end = (int)(std::upper_bound(cellKeys.begin() + begin, cellKeys.end(), keyOf(glm::ivec3(INT_MAX / 2, coord.y, coord.z))) - cellKeys.begin());
+            int from = begin, to = begin, last = INT_MIN;
+            for (int c = rows[row]; c < rows[row + 1]; c++) {
+                int k = c * numRuns + r;
+                int x = cellCoords[c].x + runs[r].first.x;
+                vec moved = shift;
+                if (periodic(0)) {
+                    // single cells that wrap along x, where the sweep starts over
+                    T length = upper[0] - lower[0];
+                    while (x < 0) x += period.x, moved[0] -= length;
+                    while (x >= period.x) x -= period.x, moved[0] += length;
+                    if (x < last) from = to = begin;
+                    last = x;
+                }
+                while (from < end && cellCoords[from].x < x) from++;
+                while (to < end && cellCoords[to].x < x + runs[r].cells) to++;
+                neighborRanges[k].from = cellStart[from];
+                neighborRanges[k].to = cellStart[to];
+                neighborRanges[k].cell = from;
+                if (wrap) neighborShifts[k] = moved;
+            }
+        }
+    }
+}
+
+template <int D, typename T>
+void SphSolver<D, T>::checkBoundary(State& p) {
+    T r = (T)Particle::radius * p.h / (T)Particle::s_Radius;
+    if (D == 2 && Obstacles::enabled) {
+        // only the obstacles binned in the particle's cell, before the walls so that it stays inside
+        glm::ivec2 cell = glm::ivec2(coordOf(p.pos));
+        glm::vec2 pos((float)p.pos[0], (float)p.pos[1]);
+        glm::vec2 velocity((float)p.velocity[0], (float)p.velocity[1]);
+        if (Obstacles::covers(cell) && Obstacles::collide(cell, pos, velocity, (float)r)) {
+            for (int k = 0; k < 2; k++) {
+                p.pos[k] = (T)pos[k];
+                p.velocity[k] = (T)velocity[k];
+            }
+        }
+    }
+    if (D == 2 && Container::enabled) {
+        // pushed out along the distance gradient, the velocity into the wall reflected at half speed
+        Container::Sample s;
+        Container::sample((float)p.pos[0], (float)p.pos[1], s);
+        T depth = r - (T)s.distance;
+        if (depth <= T(0)) return;
+        vec normal = vec(T(0));
+        for (int k = 0; k < 2; k++) normal[k] = (T)s.normal[k];
+        p.pos += depth * normal;
+        T speed = glm::dot(p.velocity, normal);
+        if (speed < T(0)) p.velocity -= T(1.5) * speed * normal;
+        return;
+    }
+    if (D == 2 && Emitters::enabled) {
+        // a particle that got past a wall stays out, Emitters::update removes it at the end of the step
+        for (int k = 0; k < D; k++)
+            if (!periodic(k) && (p.pos[k] < lower[k] || p.pos[k] > upper[k])) return;
+    }
+    for (int k = 0; k < D; k++) {
+        if (periodic(k)) {
+            // out one side, in at the other
+            if (p.pos[k] < lower[k]) p.pos[k] += upper[k] - lower[k];
+            else if (p.pos[k] >= upper[k]) p.pos[k] -= upper[k] - lower[k];
+            continue;
+        }
+        if (p.pos[k] < lower[k] + r) p.pos[k] = lower[k] + r, p.velocity[k] = -p.velocity[k] * T(0.5);
+        if (p.pos[k] > upper[k] - r) p.pos[k] = upper[k] - r, p.velocity[k] = -p.velocity[k] * T(0.5);
+    }
+}
+
+template <int D, typename T>
+T SphSolver<D, T>::stepLimit(T h, T speed, T accel, T rate, const char*& limit) {
+    // pressure waves travel at sqrt(dP/drho) on top of the flow itself
+    T soundSpeed = std::sqrt((T)Particle::pressureMultiplier);
+    T cfl = (T)Particle::cflNumber * h / (speed + soundSpeed);
+    T force = accel > T(0) ? (T)Particle::forceNumber * std::sqrt(h / accel) : (T)Particle::maxStepSize;
+    T visc = rate > T(0) ? (T)Particle::viscosityNumber / rate : (T)Particle::maxStepSize;
+
+    T dt = cfl;
+    limit = "cfl";
+    if (force < dt) dt = force, limit = "force";
+    if (visc < dt) dt = visc, limit = "viscosity";
+    return dt;
+}
+
+template <int D, typename T>
+T SphSolver<D, T>::adaptiveStepSize() {
+    T maxSpeed = T(0);
+    T maxAccel = T(200); // gravity, before the first forces are known
+    T maxRate = T(0);
+    T h = (T)Particle::s_Radius;
+    for (int i = 0; i < particles.size(); ++i) {
+        const State& p = particles[i];
+        h = std::min(h, p.h);
+        maxSpeed = std::max(maxSpeed, glm::length(p.velocity));
+        maxAccel = std::max(maxAccel, glm::length(p.acceleration));
+        maxRate = std::max(maxRate, p.viscosityRate);
+    }
+
+    // across the finest particles
+    T dt = stepLimit(h, maxSpeed, maxAccel, maxRate, Particle::dtLimit);
+
+    // grow gradually so a sudden splash after a calm stretch is not taken with a huge step
+    T last = (T)Particle::dt;
+    if (last > T(0) && dt > T(1.25) * last) dt = T(1.25) * last, Particle::dtLimit = "growth";
+    if (dt > (T)Particle::maxStepSize) dt = (T)Particle::maxStepSize, Particle::dtLimit = "max";
+    if (dt < (T)Particle::minStepSize) dt = (T)Particle::minStepSize, Particle::dtLimit = "min";
+    return dt;
+}
+
+template <int D, typename T>
+int SphSolver<D, T>::chooseRung(const State& p, T dt) {
+    // the longest power of two multiple of the step the particle's own limits allow, at most one rung
+    // above its fastest neighbor, and only one that the step count is aligned to. The limits only
+    // hold relative to each other: the global step is what keeps the tightest particle stable, so a
+    // particle only goes up a rung where its own limit is as many times looser than the tightest
+    const char* limit;
+    T local = stepLimit(p.h, glm::length(p.velocity), glm::length(p.acceleration), p.viscosityRate, limit);
+    int aligned = substep + 1;
+    int rung = 0;
+    while (rung < Particle::maxRung && rung <= p.neighborRung && (aligned & (1 << rung)) == 0
+        && std::max(dt, tightest) * (T)(2 << rung) <= local)
+        rung++;
+    return rung;
+}
+
+template <int D, typename T>
+template <bool Variable, bool Fast>
+void SphSolver<D, T>::calculateDensities() {
+    const Kernels<D, T> uniform;
+    const T invUniformH = T(1) / uniform.h;
+    int count = (int)particles.size();
+    bool wrap = !neighborShifts.empty();
+
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < count; i++) {
+        State& p = particles[i];
+        if (p.asleep || !due(p)) continue;
+        T density = T(0);
+        T nearDensity = T(0);
+        // the cells this particle's largest pair smoothing length reaches from its predicted position, and
+        // as far again as a neighbor may have drifted from where it was sorted
+        CellBlock local;
+        int home = particleCell[i];
+        const CellBlock* block = Variable ? &blockOf(p.predictedPos, cellCoords[home], T(0.5) * (p.h + maxSmoothing) + maxDrift, local) : nullptr;
+        CellWalk<D, T> walk(home, block);
+        int from, to;
+        vec shift;
+        while (walk.next(from, to, shift)) {
+            // a wrapped cell's particles are a period away, moved by it through the origin
+            vec origin = p.predictedPos;
+            if (wrap) origin -= shift;
+            for (int k = from; k < to; k++) {
+                int j = sorted[k];
+                if (j == i) continue;
+                const State& n = particles[j];
+                T h = Variable ? T(0.5) * (p.h + n.h) : uniform.h;
+                T dst, val, near;
+                if (Fast) {
+                    // poly6 only needs the squared distance, the near kernel gets it from rsqrt
+                    vec offset = n.predictedPos - origin;
+                    T r2 = glm::dot(offset, offset);
+                    if (r2 >= h * h) continue;
+                    dst = r2 > T(0) ? r2 * rsqrt(r2) : T(0);
+                    val = h * h - r2;
+                    near = T(1) - dst * (Variable ? rsqrt(h * h) : invUniformH);
+                }
+                else {
+                    dst = glm::length(n.predictedPos - origin);
+                    if (dst >= h) continue;
+                    val = h * h - dst * dst;
+                    near = T(1) - dst / h;
+                }
+                T mass = Variable ? n.mass : T(1);
+                T scale = Variable ? uniform.scaled(h).density : uniform.density;
+                density += mass * val * val * val * scale;
+                nearDensity += mass * near * near * near;
+            }
+        }
+        finishDensity(p, density, nearDensity);
+    }
+}
+
+template <int D, typename T>
+void SphSolver<D, T>::finishDensity(State& p, T density, T nearDensity) {
+    if (D == 2 && Container::enabled) {
+        // the solid within reach, as if it were fluid at rest
+        Container::Sample s;
+        Container::sample((float)p.predictedPos[0], (float)p.predictedPos[1], s);
+        density += (T)s.density;
+        nearDensity += (T)s.nearDensity;
+    }
+    p.density = density;
+    p.nearDensity = nearDensity;
+}
+
+template <int D, typename T>
+template <bool Variable, bool Fused, bool Fast>
+int SphSolver<D, T>::calculateForces(const vec* velocities, T kick) {
+    const Kernels<D, T> uniform;
+    const T invUniformH = T(1) / uniform.h;
+    int count = (int)particles.size();
+
+    // near pressure and viscosity were tuned against the 2D densities, scaled for the 3D ones
+    T densityScale = targetDensity / (T)Particle::targetDensity;
+    T pressureMultiplier = (T)Particle::pressureMultiplier;
+    T nearPressureMultiplier = (T)Particle::nearPressureMultiplier * densityScale;
+    bool wrap = !neighborShifts.empty();
+    int stepped = 0;
+
+    // all from the same velocities so the result does not depend on particle order
+#pragma omp parallel for schedule(dynamic, 64) reduction(+:stepped)
+    for (int i = 0; i < count; i++) {
+        State& p = particles[i];
+        if (p.asleep || !due(p)) continue;
+        vec force = vec(T(0));
+        vec viscosity = vec(T(0));
+        glm::vec<3, T> vorticity = glm::vec<3, T>(T(0));
+        vec colorGradient = vec(T(0));
+        T rate = T(0);
+        int neighborRung = Particle::maxRung;
+        T pressureB = (p.density - targetDensity) * pressureMultiplier;
+        CellBlock local;
+        int home = particleCell[i];
+        CellWalk<D, T> walk(home, Variable ? &blockOf(p.pos, cellCoords[home], T(0.5) * (p.h + maxSmoothing), local) : nullptr);
+        int from, to;
+        vec shift;
+        while (walk.next(from, to, shift)) {
+            vec origin = p.pos;
+            if (wrap) origin -= shift;
+            for (int k = from; k < to; k++) {
+                int j = sorted[k];
+                if (j == i) continue;
+                const State& n = particles[j];
+                vec offset = n.pos - origin;
+                T h = Variable ? T(0.5) * (p.h + n.h) : uniform.h;
+                // Fast: the distance, the direction and the inverse density from two rsqrt
+                T dst, invDst;
+                if (Fast) {
+                    T r2 = glm::dot(offset, offset);
+                    if (r2 >= h * h || r2 < T(1e-12)) continue;
+                    invDst = rsqrt(r2);
+                    dst = r2 * invDst;
+                }
+                else {
+                    dst = glm::length(offset);
+                    if (dst >= h || dst < T(1e-6)) continue;
+                }
+                neighborRung = std::min(neighborRung, n.rung);
+                const Kernels<D, T> kernels = Variable ? uniform.scaled(h) : uniform;
+                T mass = Variable ? n.mass : T(1);
+                vec dir = Fast ? offset * invDst : offset / dst;
+                T dens = std::max(n.density, T(1e-4));
+                T invDens = T(0);
+                if (Fast) invDens = rsqrt(dens), invDens *= invDens;
+
+                T pressureA = (n.density - targetDensity) * pressureMultiplier;
+                T val = h - dst;
+                T near = T(1) - (Fast ? dst * (Variable ? rsqrt(h * h) : invUniformH) : dst / h);
+                T sharedPressure = Fast ? val * val * kernels.pressure * (pressureA + pressureB) * T(0.5) * invDens
+                                        : val * val * kernels.pressure * (pressureA + pressureB) / (T(2) * dens);
+                sharedPressure += near * near * kernels.near * n.nearDensity * nearPressureMultiplier;
+                force += dir * sharedPressure * mass;
+
+                // fused, a neighbor done before this particle has been kicked already
+                const vec& velocity = Fused ? velocities[j] : n.velocity;
+                T influence = val * kernels.viscosity * mass;
+                viscosity += (velocity - p.velocity) * influence;
+                rate += influence;
+
+                if (Variable) {
+                    vec gradient = dir * (Fast ? val * val * kernels.pressure * mass * invDens : val * val * kernels.pressure * mass / dens);
+                    vorticity += curl<T>(velocity - p.velocity, gradient);
+                    colorGradient += gradient;
+                }
+            }
+        }
+        p.neighborRung = neighborRung;
+        p.vorticity = Variable ? glm::length(vorticity) : T(0);
+        p.surface = Variable ? glm::length(colorGradient) * p.h : T(0);
+        finishForces<Fused>(p, force, viscosity, rate, kick);
+        if (Fused) stepped++;
+    }
+    return stepped;
+}
+
+template <int D, typename T>
+template <bool Fused>
+void SphSolver<D, T>::finishForces(State& p, vec force, vec viscosity, T rate, T kick) {
+    // the same multipliers as the neighbor sums
+    T densityScale = targetDensity / (T)Particle::targetDensity;
+    T pressureB = (p.density - targetDensity) * (T)Particle::pressureMultiplier;
+    T nearPressureMultiplier = (T)Particle::nearPressureMultiplier * densityScale;
+    T viscosityMultiplier = (T)Particle::viscosityMultiplier / densityScale;
+    if (D == 2 && Container::enabled) {
+        // the walls mirror the particle's pressure and hold it back like resting fluid
+        Container::Sample s;
+        Container::sample((float)p.pos[0], (float)p.pos[1], s);
+        for (int k = 0; k < 2; k++)
+            force[k] += (T)s.pressure[k] * pressureB / targetDensity + (T)s.nearPressure[k] * p.nearDensity * nearPressureMultiplier;
+        viscosity -= p.velocity * (T)s.viscosity;
+        rate += (T)s.viscosity;
+    }
+    // the velocity relaxes towards the neighbors at this rate, an explicit step must stay below its inverse
+    p.viscosityRate = rate * viscosityMultiplier;
+
+    T dens = std::max(p.density, T(1e-4));
+    p.acceleration = (force + viscosity * viscosityMultiplier * p.density) / dens;
+    p.acceleration[1] -= T(200);
+
+    if (Fused) {
+        p.velocity += kick * p.acceleration;
+        p.elapsed = T(0);
+        T velMag = glm::length(p.velocity);
+        // velocity clamp
+        if (velMag > T(15)) p.velocity = T(15) * p.velocity / velMag;
+    }
+}
+
+template <int D, typename T>
+void SphSolver<D, T>::packPosition(const vec& pos, int cell, unsigned short* offset) {
+    // from the cell's corner less the drift, so that the predicted positions fit as well
+    for (int k = 0; k < D; k++) {
+        T step = (cellWidth[k] + T(2) * maxDrift) / T(65535);
+        T corner = lower[k] + (T)cellCoords[cell][k] * cellWidth[k] - maxDrift;
+        offset[k] = (unsigned short)glm::clamp(std::floor((pos[k] - corner) / step + T(0.5)), T(0), T(65535));
+    }
+}
+
+template <int D, typename T>
+template <bool Variable, bool Motion>
+void SphSolver<D, T>::unpackRow(int first, int last, const Packed& packed, int* delta, TileArrays& block) {
+    // the runs of a row of cells go along the same rows of neighbor cells, which are contiguous in the sort,
+    // so every neighbor row is unpacked once from the first of the runs' ranges along it to the last
+    int numRuns = (int)runs.size();
+    Arena& scratch = Arena::local();
+    Range* spans = scratch.alloc<Range>(numRuns);
+    int total = 0;
+    for (int r = 0; r < numRuns; r++) {
+        bool along = r > 0 && runs[r].first.y == runs[r - 1].first.y && runs[r].first.z == runs[r - 1].first.z;
+        Range& span = spans[r];
+        if (along) span = spans[r - 1];
+        else span.from = INT_MAX, span.to = INT_MIN;
+        for (int home = first; home < last; home++) {
+            const Range& range = neighborRanges[home * numRuns + r];
+            if (range.from < span.from) span.from = range.from, span.cell = range.cell;
+            span.to = std::max(span.to, range.to);
+        }
+        // the last run along a row has the row's span, the earlier ones take it from there below
+        if (along) total -= spans[r - 1].to - spans[r - 1].from;
+        total += span.to - span.from;
+    }
+    block.position = scratch.alloc<vec>(total);
+    if (Variable) block.smoothing = scratch.alloc<T>(total), block.mass = scratch.alloc<T>(total);
+    if (Motion) {
+        block.velocity = scratch.alloc<vec>(total);
+        block.density = scratch.alloc<T>(total);
+        block.nearDensity = scratch.alloc<T>(total);
+        block.rung = scratch.alloc<int>(total);
+    }
+
+    vec step = (cellWidth + T(2) * maxDrift) / T(65535);
+    int n = 0;
+    for (int r = numRuns - 1; r >= 0; r--) {
+        const Range& span = spans[r];
+        bool along = r + 1 < numRuns && runs[r + 1].first.y == runs[r].first.y && runs[r + 1].first.z == runs[r].first.z;
+        if (along) {
+            delta[r] = delta[r + 1];
+            continue;
+        }
+        delta[r] = span.from - n;
+        if (runs[r].first.y == 0 && runs[r].first.z == 0) delta[numRuns] = delta[r];
+        // the row's cells in turn, every particle from its own cell's corner
+        int from = span.from;
+        for (int c = span.cell; from < span.to; c++) {
+            vec corner;
+            for (int k = 0; k < D; k++) corner[k] = lower[k] + (T)cellCoords[c][k] * cellWidth[k] - maxDrift;
+            for (int end = cellStart[c + 1]; from < end; from++, n++) {
+                const unsigned short* offset = packed.offsets + from * D;
+                for (int k = 0; k < D; k++) block.position[n][k] = corner[k] + (T)offset[k] * step[k];
+                if (Variable) {
+                    int level = packed.levels[from] - Multires::minLevel;
+                    block.smoothing[n] = packed.levelSmoothing[level];
+                    block.mass[n] = packed.levelMass[level];
+                }
+                if (Motion) {
+                    const PackedMotion& m = packed.motions[from];
+                    for (int k = 0; k < D; k++) block.velocity[n][k] = (T)fromHalf(m.velocity[k]);
+                    block.density[n] = targetDensity * (T(1) + (T)fromHalf(m.compression));
+                    block.nearDensity[n] = (T)fromHalf(m.nearDensity);
+                    block.rung[n] = m.rung;
+                }
+            }
+        }
+    }
+}
+
+// the smoothing lengths and masses of the levels, as Multires gives them
+template <int D, typename T>
+static void packLevels(T* smoothing, T* mass) {
+    for (int l = 0; l < SphSolver<D, T>::LEVELS; l++) {
+        int level = Multires::minLevel + l;
+        smoothing[l] = (T)Particle::s_Radius * std::pow(T(2), T(level) / T(D));
+        mass[l] = std::pow(T(2), T(level));
+    }
+}
+
+template <int D, typename T>
+template <bool Variable, bool Compact, bool Fast>
+void SphSolver<D, T>::tileDensities() {
+    const Kernels<D, T> uniform;
+    const T invUniformH = T(1) / uniform.h;
+    int count = cellStart.back();
+    int cells = (int)cellKeys.size();
+    int numRuns = (int)runs.size();
+    bool wrap = !neighborShifts.empty();
+
+    // the predicted positions in the cells' order, with Variable the smoothing lengths and masses, by the
+    // same index, or with Compact packed
+    Arena& arena = Arena::local();
+    TileArrays copies = TileArrays();
+    Packed packed = Packed();
+    if (Compact) {
+        packed.offsets = arena.alloc<unsigned short>(count * D);
+        if (Variable) packed.levels = arena.alloc<signed char>(count), packLevels<D, T>(packed.levelSmoothing, packed.levelMass);
+    }
+    else {
+        copies.position = arena.alloc<vec>(count);
+        if (Variable) copies.smoothing = arena.alloc<T>(count), copies.mass = arena.alloc<T>(count);
+    }
+    unsigned char* active = arena.alloc<unsigned char>(count);
+#pragma omp parallel for schedule(static)
+    for (int k = 0; k < count; k++) {
+        int j = sorted[k];
+        const State& p = particles[j];
+        if (Compact) {
+            packPosition(p.predictedPos, particleCell[j], packed.offsets + k * D);
+            if (Variable) packed.levels[k] = (signed char)p.level;
+        }
+        else {
+            copies.position[k] = p.predictedPos;
+            if (Variable) copies.smoothing[k] = p.h, copies.mass[k] = p.mass;
+        }
+        active[k] = !p.asleep && due(p);
+    }
+
+    // a tile is the particles of the home cell against a run of neighbor cells, tested without a branch:
+    // every pair is written to the particle's list, which only moves past it when it is within reach.
+    // The sums then go down the lists, over the pairs within reach alone and in the order
+    // calculateDensities takes them, so they are the same to the bit. Compact goes a row of cells at a time:
+    // the particles their blocks cover are unpacked once for the row, each run's range of the sort less its
+    // delta indexes them
+    int numRows = Compact ? (int)rowStart.size() - 1 : cells;
+#pragma omp parallel for schedule(dynamic, Compact ? 1 : 16)
+    for (int row = 0; row < numRows; row++) {
+        int firstHome = Compact ? rowStart[row] : row, lastHome = Compact ? rowStart[row + 1] : row + 1;
+        Arena& scratch = Arena::local();
+        int* delta = Compact ? scratch.alloc<int>(numRuns + 1) : nullptr;
+        TileArrays block = copies;
+        if (Compact) unpackRow<Variable, false>(firstHome, lastHome, packed, delta, block);
+        const vec* position = block.position;
+        const T* smoothing = block.smoothing;
+        const T* mass = block.mass;
+        for (int home = firstHome; home < lastHome; home++) {
+            int first = cellStart[home], last = cellStart[home + 1];
+            const Range* ranges = &neighborRanges[home * numRuns];
+            int self = Compact ? first - delta[numRuns] : first;
+            int candidates = 0;
+            for (int r = 0; r < numRuns; r++) candidates += ranges[r].to - ranges[r].from;
+            // a particle's list and the runs of its pairs from (a - first) * candidates on
+            int* pairs = scratch.alloc<int>((last - first) * candidates);
+            int* pairRun = wrap ? scratch.alloc<int>((last - first) * candidates) : nullptr;
+            int* found = scratch.alloc<int>(last - first);
+            for (int a = first; a < last; a++) found[a - first] = (a - first) * candidates;
+
+            for (int r = 0; r < numRuns; r++) {
+                int from = Compact ? ranges[r].from - delta[r] : ranges[r].from;
+                int to = Compact ? ranges[r].to - delta[r] : ranges[r].to;
+                vec shift = wrap ? neighborShifts[home * numRuns + r] : vec(T(0));
+                for (int a = first; a < last; a++) {
+                    if (!active[a]) continue;
+                    // a wrapped cell's particles are a period away, moved by it through the origin
+                    int i = self + a - first;
+                    vec origin = wrap ? position[i] - shift : position[i];
+                    T h = Variable ? smoothing[i] : uniform.h;
+                    int n = found[a - first];
+                    for (int k = from; k < to; k++) {
+                        vec offset = position[k] - origin;
+                        T r2 = glm::dot(offset, offset);
+                        T reach = Variable ? T(0.5) * (h + smoothing[k]) : uniform.h;
+                        pairs[n] = k;
+                        if (wrap) pairRun[n] = r;
+                        n += (r2 < reach * reach * T(TILE_MARGIN)) & (k != i);
+                    }
+                    found[a - first] = n;
+                }
+            }
+
+            for (int a = first; a < last; a++) {
+                if (!active[a]) continue;
+                int i = self + a - first;
+                T density = T(0);
+                T nearDensity = T(0);
+                T rowSmoothing = Variable ? smoothing[i] : uniform.h;
+                for (int e = (a - first) * candidates; e < found[a - first]; e++) {
+                    int k = pairs[e];
+                    vec offset = position[k] - (wrap ? position[i] - neighborShifts[home * numRuns + pairRun[e]] : position[i]);
+                    T r2 = glm::dot(offset, offset);
+                    T h = Variable ? T(0.5) * (rowSmoothing + smoothing[k]) : uniform.h;
+                    T dst, val, near;
+                    bool in;
+                    if (Fast) {
+                        // poly6 only needs the squared distance, the near kernel gets it from rsqrt
+                        in = r2 < h * h;
+                        dst = r2 * rsqrt(r2 > T(0) ? r2 : T(1));
+                        val = h * h - r2;
+                        near = T(1) - dst * (Variable ? rsqrt(h * h) : invUniformH);
+                    }
+                    else {
+                        dst = std::sqrt(r2);
+                        in = dst < h;
+                        val = h * h - dst * dst;
+                        near = T(1) - dst / h;
+                    }
+                    T neighborMass = Variable ? mass[k] : T(1);
+                    T scale = Variable ? uniform.scaled(h).density : uniform.density;
+                    density += in ? neighborMass * val * val * val * scale : T(0);
+                    nearDensity += in ? neighborMass * near * near * near : T(0);
+                }
+                finishDensity(particles[sorted[a]], density, nearDensity);
+            }
+            scratch.trim(pairs, 0);
+        }
+        if (Compact) scratch.trim(delta, 0);
+    }
+}
+
+template <int D, typename T>
+template <bool Variable, bool Fused, bool Compact, bool Fast>
+int SphSolver<D, T>::tileForces(const vec* velocities, T kick) {
+    const Kernels<D, T> uniform;
+    const T invUniformH = T(1) / uniform.h;
+    int count = cellStart.back();
+    int cells = (int)cellKeys.size();
+    int numRuns = (int)runs.size();
+    bool wrap = !neighborShifts.empty();
+
+    T densityScale = targetDensity / (T)Particle::targetDensity;
+    T pressureMultiplier = (T)Particle::pressureMultiplier;
+    T nearPressureMultiplier = (T)Particle::nearPressureMultiplier * densityScale;
+
+    // what the neighbor sums read, in the cells' order, or with Compact packed
+    Arena& arena = Arena::local();
+    TileArrays copies = TileArrays();
+    Packed packed = Packed();
+    if (Compact) {
+        packed.offsets = arena.alloc<unsigned short>(count * D);
+        packed.motions = arena.alloc<PackedMotion>(count);
+        if (Variable) packed.levels = arena.alloc<signed char>(count), packLevels<D, T>(packed.levelSmoothing, packed.levelMass);
+    }
+    else {
+        copies.position = arena.alloc<vec>(count);
+        copies.velocity = arena.alloc<vec>(count);
+        if (Variable) copies.smoothing = arena.alloc<T>(count), copies.mass = arena.alloc<T>(count);
+        copies.density = arena.alloc<T>(count);
+        copies.nearDensity = arena.alloc<T>(count);
+        copies.rung = arena.alloc<int>(count);
+    }
+    unsigned char* active = arena.alloc<unsigned char>(count);
+#pragma omp parallel for schedule(static)
+    for (int k = 0; k < count; k++) {
+        int j = sorted[k];
+        const State& p = particles[j];
+        // fused, the snapshot the drift took, which a particle's own velocity still is before its kick
+        const vec& v = Fused ? velocities[j] : p.velocity;
+        if (Compact) {
+            packPosition(p.pos, particleCell[j], packed.offsets + k * D);
+            PackedMotion& m = packed.motions[k];
+            for (int c = 0; c < D; c++) m.velocity[c] = toHalf((float)v[c]);
+            m.compression = toHalf((float)(p.density / targetDensity - T(1)));
+            m.nearDensity = toHalf((float)p.nearDensity);
+            m.rung = (unsigned char)p.rung;
+            if (Variable) packed.levels[k] = (signed char)p.level;
+        }
+        else {
+            copies.position[k] = p.pos;
+            copies.velocity[k] = v;
+            if (Variable) copies.smoothing[k] = p.h, copies.mass[k] = p.mass;
+            copies.density[k] = p.density;
+            copies.nearDensity[k] = p.nearDensity;
+            copies.rung[k] = p.rung;
+        }
+        active[k] = !p.asleep && due(p);
+    }
+
+    // the lists as in tileDensities
+    int stepped = 0;
+    int numRows = Compact ? (int)rowStart.size() - 1 : cells;
+#pragma omp parallel for schedule(dynamic, Compact ? 1 : 16) reduction(+:stepped)
+    for (int row = 0; row < numRows; row++) {
+        int firstHome = Compact ? rowStart[row] : row, lastHome = Compact ? rowStart[row + 1] : row + 1;
+        Arena& scratch = Arena::local();
+        int* delta = Compact ? scratch.alloc<int>(numRuns + 1) : nullptr;
+        TileArrays block = copies;
+        if (Compact) unpackRow<Variable, true>(firstHome, lastHome, packed, delta, block);
+        const vec* position = block.position;
+        const vec* velocity = block.velocity;
+        const T* smoothing = block.smoothing;
+        const T* mass = block.mass;
+        const T* density = block.density;
+        const T* nearDensity = block.nearDensity;
+        const int* rung = block.rung;
+        for (int home = firstHome; home < lastHome; home++) {
+            int first = cellStart[home], last = cellStart[home + 1];
+            const Range* ranges = &neighborRanges[home * numRuns];
+            int self = Compact ? first - delta[numRuns] : first;
+            int candidates = 0;
+            for (int r = 0; r < numRuns; r++) candidates += ranges[r].to - ranges[r].from;
+            int* pairs = scratch.alloc<int>((last - first) * candidates);
+            int* pairRun = wrap ? scratch.alloc<int>((last - first) * candidates) : nullptr;
+            int* found = scratch.alloc<int>(last - first);
+            for (int a = first; a < last; a++) found[a - first] = (a - first) * candidates;
+
+            for (int r = 0; r < numRuns; r++) {
+                int from = Compact ? ranges[r].from - delta[r] : ranges[r].from;
+                int to = Compact ? ranges[r].to - delta[r] : ranges[r].to;
+                vec shift = wrap ? neighborShifts[home * numRuns + r] : vec(T(0));
+                for (int a = first; a < last; a++) {
+                    if (!active[a]) continue;
+                    int i = self + a - first;
+                    vec origin = wrap ? position[i] - shift : position[i];
+                    T h = Variable ? smoothing[i] : uniform.h;
+                    int n = found[a - first];
+                    for (int k = from; k < to; k++) {
+                        vec offset = position[k] - origin;
+                        T r2 = glm::dot(offset, offset);
+                        T reach = Variable ? T(0.5) * (h + smoothing[k]) : uniform.h;
+                        pairs[n] = k;
+                        if (wrap) pairRun[n] = r;
+                        n += (r2 < reach * reach * T(TILE_MARGIN)) & (k != i);
+                    }
+                    found[a - first] = n;
+                }
+            }
+
+            for (int a = first; a < last; a++) {
+                if (!active[a]) continue;
+                int i = self + a - first;
+                State& p = particles[sorted[a]];
+                vec force = vec(T(0));
+                vec viscosity = vec(T(0));
+                glm::vec<3, T> vorticity = glm::vec<3, T>(T(0));
+                vec colorGradient = vec(T(0));
+                T rate = T(0);
+                int neighborRung = Particle::maxRung;
+                T pressureB = (density[i] - targetDensity) * pressureMultiplier;
+                T rowSmoothing = Variable ? smoothing[i] : uniform.h;
+                for (int e = (a - first) * candidates; e < found[a - first]; e++) {
+                    int k = pairs[e];
+                    vec offset = position[k] - (wrap ? position[i] - neighborShifts[home * numRuns + pairRun[e]] : position[i]);
+                    T r2 = glm::dot(offset, offset);
+                    T h = Variable ? T(0.5) * (rowSmoothing + smoothing[k]) : uniform.h;
+                    // Fast: the distance, the direction and the inverse density from two rsqrt. A masked pair
+                    // takes a distance of 1, so that nothing it computes is infinite
+                    T dst, invDst;
+                    bool in;
+                    if (Fast) {
+                        in = (r2 < h * h) & (r2 >= T(1e-12));
+                        T safe = in ? r2 : T(1);
+                        invDst = rsqrt(safe);
+                        dst = safe * invDst;
+                    }
+                    else {
+                        dst = std::sqrt(r2);
+                        in = (dst < h) & (dst >= T(1e-6));
+                        dst = in ? dst : T(1);
+                    }
+                    const Kernels<D, T> kernels = Variable ? uniform.scaled(h) : uniform;
+                    T neighborMass = Variable ? mass[k] : T(1);
+                    vec dir = Fast ? offset * invDst : offset / dst;
+                    T dens = std::max(density[k], T(1e-4));
+                    T invDens = T(0);
+                    if (Fast) invDens = rsqrt(dens), invDens *= invDens;
+
+                    T pressureA = (density[k] - targetDensity) * pressureMultiplier;
+                    T val = h - dst;
+                    T near = T(1) - (Fast ? dst * (Variable ? rsqrt(h * h) : invUniformH) : dst / h);
+                    T sharedPressure = Fast ? val * val * kernels.pressure * (pressureA + pressureB) * T(0.5) * invDens
+                                            : val * val * kernels.pressure * (pressureA + pressureB) / (T(2) * dens);
+                    sharedPressure += near * near * kernels.near * nearDensity[k] * nearPressureMultiplier;
+                    T influence = val * kernels.viscosity * neighborMass;
+                    vec relative = velocity[k] - velocity[i];
+                    force += in ? dir * sharedPressure * neighborMass : vec(T(0));
+                    viscosity += in ? relative * influence : vec(T(0));
+                    rate += in ? influence : T(0);
+                    neighborRung = in ? std::min(neighborRung, rung[k]) : neighborRung;
+
+                    if (Variable) {
+                        vec gradient = dir * (Fast ? val * val * kernels.pressure * neighborMass * invDens : val * val * kernels.pressure * neighborMass / dens);
+                        vorticity += in ? curl<T>(relative, gradient) : glm::vec<3, T>(T(0));
+                        colorGradient += in ? gradient : vec(T(0));
+                    }
+                }
+                p.neighborRung = neighborRung;
+                p.vorticity = Variable ? glm::length(vorticity) : T(0);
+                p.surface = Variable ? glm::length(colorGradient) * p.h : T(0);
+                finishForces<Fused>(p, force, viscosity, rate, kick);
+                if (Fused) stepped++;
+            }
+            scratch.trim(pairs, 0);
+        }
+        if (Compact) scratch.trim(delta, 0);
+    }
+    return stepped;
+}
+
+template <int D, typename T>
+template <bool Variable, bool Fused>
+int SphSolver<D, T>::calculate(const vec* velocities, T kick) {
+    // tiles need the same block around every cell, with Multires that of the largest smoothing length
+    if (Particle::cellTiles && Particle::compactStorage) {
+        if (Particle::fastMath) {
+            tileDensities<Variable, true, true>();
+            return tileForces<Variable, Fused, true, true>(velocities, kick);
+        }
+        tileDensities<Variable, true, false>();
+        return tileForces<Variable, Fused, true, false>(velocities, kick);
+    }
+    if (Particle::cellTiles) {
+        if (Particle::fastMath) {
+            tileDensities<Variable, false, true>();
+            return tileForces<Variable, Fused, false, true>(velocities, kick);
+        }
+        tileDensities<Variable, false, false>();
+        return tileForces<Variable, Fused, false, false>(velocities, kick);
+    }
+    if (Particle::fastMath) {
+        calculateDensities<Variable, true>();
+        return calculateForces<Variable, Fused, true>(velocities, kick);
+    }
+    calculateDensities<Variable, false>();
+    return calculateForces<Variable, Fused, false>(velocities, kick);
+}
+
+template <int D, typename T>
+int SphSolver<D, T>::kickAll(T dt, T kick) {
+    bool leapfrog = Particle::leapfrog;
+    bool local = Particle::localSteps;
+    int count = (int)particles.size();
+    int stepped = 0;
+    // the tightest limit over every particle, the due ones choose their rungs against it
+    if (local) {
+        tightest = T(-1);
+        const char* limit;
+        for (int i = 0; i < count; i++) {
+            const State& p = particles[i];
+            if (p.asleep) continue;
+            T l = stepLimit(p.h, glm::length(p.velocity), glm::length(p.acceleration), p.viscosityRate, limit);
+            if (tightest < T(0) || l < tightest) tightest = l;
+        }
+    }
+#pragma omp parallel for schedule(static) reduction(+:stepped)
+    for (int i = 0; i < count; i++) {
+        State& p = particles[i];
+        if (p.asleep || !due(p)) continue;
+        stepped++;
+        if (local) {
+            // leapfrog closes the step with the time drifted that the opening kick did not cover, as the
+            // global second half kick, symplectic Euler kicks the whole of the next step on the new rung
+            p.rung = chooseRung(p, dt);
+            if (leapfrog) p.velocity += (p.elapsed - p.opened) * p.acceleration;
+            else p.velocity += dt * (T)(1 << p.rung) * p.acceleration;
+        }
+        else p.velocity += kick * p.acceleration;
+        p.elapsed = T(0);
+        T velMag = glm::length(p.velocity);
+        // velocity clamp
+        if (velMag > T(15)) p.velocity = T(15) * p.velocity / velMag;
+    }
+    return stepped;
+}
+
+template <int D, typename T>
+void SphSolver<D, T>::step() {
+    if (!loaded) load();
+    int count = (int)particles.size();
+    bool leapfrog = Particle::leapfrog;
+    bool local = Particle::localSteps;
+    T dt = (T)Particle::stepSize;
+    if (Particle::adaptive) {
+        // local steps keep the adaptive step until the deepest rung lines up again, where every particle's
+        // step ends, so that a particle's 2^rung steps are all as long
+        if (!local || (substep & ((1 << Particle::maxRung) - 1)) == 0 || heldStep <= T(0)) heldStep = adaptiveStepSize();
+        dt = heldStep;
+    }
+    // leapfrog kicks half a step with the last forces before the drift and half a step after
+    T kick = leapfrog ? T(0.5) * dt : dt;
+    // local steps choose rungs from the neighbors' rungs, which a fused kick would change under them
+    bool fused = Particle::fusedForces && !local;
+    vec* velocities = fused ? Arena::local().alloc<vec>(count) : nullptr;
+
+    // the obstacles where they will be at the end of this step
+    if (D == 2 && Obstacles::enabled) {
+        Obstacles::update(Particle::simulatedTime + dt);
+        Obstacles::bin<D, T>();
+    }
+
+    // change position, predict positions for density calculations
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) {
+        State& p = particles[i];
+        if (!p.asleep) {
+            // local steps open a particle's step in the drift that starts it, half of its 2^rung steps
+            if (leapfrog && (!local || p.elapsed == T(0))) {
+                T opening = local ? T(0.5) * dt * (T)(1 << p.rung) : kick;
+                p.opened = opening;
+                p.velocity += opening * p.acceleration;
+                T velMag = glm::length(p.velocity);
+                // velocity clamp, as after the kick that closes the step
+                if (velMag > T(15)) p.velocity = T(15) * p.velocity / velMag;
+            }
+            p.pos += dt * p.velocity;
+            checkBoundary(p);
+            p.predictedPos = p.pos + dt * p.velocity;
+            p.elapsed += dt;
+        }
+        // the velocities the viscosity of a fused force pass reads
+        if (fused) velocities[i] = p.velocity;
+    }
+
+    sortCells();
+    int stepped;
+    if (Multires::enabled)
+        stepped = fused ? calculate<true, true>(velocities, kick) : calculate<true, false>(nullptr, kick);
+    else
+        stepped = fused ? calculate<false, true>(velocities, kick) : calculate<false, false>(nullptr, kick);
+    if (!fused) stepped = kickAll(dt, kick);
+
+    if (Sleep::enabled || local) {
+        int live = D == 2 && Emitters::enabled ? Emitters::numLive : count;
+        Metrics::activeFraction = live > 0 ? (double)stepped / live : 1.0;
+    }
+
+    // put quiet cells to sleep and wake the stirred ones, with this step's velocities and cells
+    if (Sleep::enabled) Sleep::update<D, T>();
+
+    // split and merge on this step's densities, vorticity and cells
+    if (Multires::enabled) Multires::refine<D, T>();
+
+    // drains and emitters on this step's cells, then compaction once enough slots are dead
+    if (D == 2 && Emitters::enabled) Emitters::update<D, T>();
+
+    filed = false;
+    Particle::dt = (float)dt;
+    Particle::simulatedTime += dt;
+    Particle::numSteps++;
+    substep++;
+}
+
+template <int D, typename T>
+bool SphSolver<D, T>::validate(int steps, bool& mode, const char* name, double tolerance, double outliers) {
+    // the reference step runs on, and after every step its densities and forces are taken again from
+    // the state it ended with, with the mode off and on, so that the deviations do not grow with the
+    // chaos of the flow
+    bool enabled = mode;
+    std::vector <State> stepped, exact;
+    T maxDensity = T(0), maxForce = T(0);
+    long long numOver = 0, numCompared = 0;
+    for (int s = 0; s < steps; s++) {
+        Arena::resetAll();
+        mode = false;
+        step();
+        stepped = particles;
+        sortCells();
+        for (int on = 0; on < 2; on++) {
+            mode = on != 0;
+            if (Multires::enabled) calculate<true, false>(nullptr, T(0));
+            else calculate<false, false>(nullptr, T(0));
+            if (!on) exact = particles;
+        }
+
+        T density = T(0), force = T(0), largest = T(0);
+        for (int i = 0; i < particles.size(); i++) {
+            density = std::max(density, std::abs(particles[i].density - exact[i].density));
+            force = std::max(force, glm::length(particles[i].acceleration - exact[i].acceleration));
+            largest = std::max(largest, glm::length(exact[i].acceleration));
+        }
+        for (int i = 0; i < particles.size(); i++) {
+            if (particles[i].asleep) continue;
+            numCompared++;
+            if (std::abs(particles[i].density - exact[i].density) >= (T)tolerance * targetDensity ||
+                glm::length(particles[i].acceleration - exact[i].acceleration) >= (T)tolerance * std::max(largest, T(1e-6))) numOver++;
+        }
+        particles.swap(stepped);
+        // relative to the rest density and the largest acceleration
+        density /= targetDensity;
+        force /= std::max(largest, T(1e-6));
+        maxDensity = std::max(maxDensity, density);
+        maxForce = std::max(maxForce, force);
+#if USE_CPP_IOSTREAM
+        std::cout
+            << name << " check step " << std::setw(4) << s + 1
+            << ": max |ddensity| " << std::scientific << std::setprecision(3) << (double)density
+            << " of the rest density  max |dforce| " << (double)force << " of the largest" << std::fixed << std::endl;
+#else
+        printf( "%s check step %4d: max |ddensity| %.3e of the rest density  max |dforce| %.3e of the largest\n", name, s + 1, (double)density, (double)force );
+#endif
+    }
+    mode = enabled;
+
+    bool pass = numOver <= (long long)(outliers * (double)numCompared);
+#if USE_CPP_IOSTREAM
+    std::cout
+        << name << " check: max |ddensity| " << std::scientific << std::setprecision(3) << (double)maxDensity
+        << " max |dforce| " << (double)maxForce << std::fixed << ", " << numOver << " of " << numCompared
+        << " over the tolerance, " << (pass ? "PASSED" : "FAILED") << std::endl;
+#else
+    printf( "%s check: max |ddensity| %.3e max |dforce| %.3e, %lld of %lld over the tolerance, %s\n", name, (double)maxDensity, (double)maxForce,
+        numOver, numCompared, pass ? "PASSED" : "FAILED" );
+#endif
+    return pass;
+}
+
+template <int D, typename T>
+bool SphSolver<D, T>::compare(int steps, bool& mode, const char* name) {
+    // the reference keeps a hash of every step's positions and velocities, the steps with the mode on
+    // are checked against them as they go
+    if (!loaded) load();
+    bool enabled = mode;
+    std::vector <State> start = particles;
+    int startSubstep = substep;
+    double startTime = Particle::simulatedTime;
+    int startSteps = Particle::numSteps;
+    float startDt = Particle::dt;
+    T startHeld = heldStep;
+    std::vector <unsigned long long> hashes(steps);
+    std::vector <State> reference;
+    int numDiffSteps = 0;
+    for (int on = 0; on < 2; on++) {
+        mode = on != 0;
+        particles = start;
+        // Particle's cells may have been filed for another state
+        reindexed = true;
+        substep = startSubstep;
+        Particle::simulatedTime = startTime;
+        Particle::numSteps = startSteps;
+        Particle::dt = startDt;
+        heldStep = startHeld;
+        for (int s = 0; s < steps; s++) {
+            Arena::resetAll();
+            step();
+            unsigned long long hash = 1469598103934665603ull;
+            for (int i = 0; i < particles.size(); i++) {
+                const unsigned char* bytes[2] = { (const unsigned char*)&particles[i].pos, (const unsigned char*)&particles[i].velocity };
+                for (int b = 0; b < 2; b++)
+                    for (int k = 0; k < (int)sizeof(vec); k++) {
+                        hash ^= bytes[b][k];
+                        hash *= 1099511628211ull;
+                    }
+            }
+            if (!on) hashes[s] = hash;
+            else if (hash != hashes[s]) numDiffSteps++;
+        }
+        if (!on) reference = particles;
+    }
+    mode = enabled;
+
+    int numDiff = 0;
+    for (int i = 0; i < particles.size(); i++)
+        if (memcmp(&particles[i].pos, &reference[i].pos, sizeof(vec)) != 0 ||
+            memcmp(&particles[i].velocity, &reference[i].velocity, sizeof(vec)) != 0) numDiff++;
+    bool pass = numDiffSteps == 0 && numDiff == 0;
+#if USE_CPP_IOSTREAM
+    std::cout
+        << name << " check: " << numDiff << " of " << particles.size() << " particles differ after " << steps
+        << " steps, " << numDiffSteps << " steps differ, " << (pass ? "PASSED" : "FAILED") << std::endl;
+#else
+    printf( "%s check: %d of %d particles differ after %d steps, %d steps differ, %s\n", name, numDiff,
+        (int)particles.size(), steps, numDiffSteps, pass ? "PASSED" : "FAILED" );
+#endif
+    return pass;
+}
+
+template class SphSolver<2, float>;
+template class SphSolver<3, float>;
+template class SphSolver<2, double>;
+template class SphSolver<3, double>;
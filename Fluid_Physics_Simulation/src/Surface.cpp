@@ -0,0 +1,254 @@
+#include "../HeaderFiles/Surface.h"
+#include "../HeaderFiles/SphSolver.h"
+#include <fstream>
+
+//Defining static members
+std::vector <float> Surface::density;
+std::vector <glm::vec2> Surface::velocity;
+std::vector <float> Surface::vertices;
+std::vector <float> Surface::polySpeeds;
+std::vector <int> Surface::polyStarts;
+std::vector <int> Surface::polyCounts;
+unsigned int Surface::vao = 0;
+unsigned int Surface::vbo = 0;
+
+// scratch buffers reused between frames
+static std::vector <std::vector<int>> rowSegments;
+static std::vector <int> segEdges;
+static std::vector <int> edgeSegs;
+static std::vector <char> segVisited;
+
+// Marching squares edge pairs for each corner case, -1 terminated.
+// Corners: v0 (i,j), v1 (i+1,j), v2 (i+1,j+1), v3 (i,j+1)
+// Edges:   e0 bottom, e1 right, e2 top, e3 left
+// Saddle cases 5 and 10 are resolved separately using the cell center.
+static const int caseEdges[16][4] = {
+    {-1, -1, -1, -1}, { 3,  0, -1, -1}, { 0,  1, -1, -1}, { 3,  1, -1, -1},
+    { 1,  2, -1, -1}, {-1, -1, -1, -1}, { 0,  2, -1, -1}, { 3,  2, -1, -1},
+    { 2,  3, -1, -1}, { 0,  2, -1, -1}, {-1, -1, -1, -1}, { 1,  2, -1, -1},
+    { 1,  3, -1, -1}, { 0,  1, -1, -1}, { 3,  0, -1, -1}, {-1, -1, -1, -1}
+};
+
+static float nodeSpacing() {
+    return 2.0f / (float)(Surface::resolution - 1);
+}
+
+// horizontal edges come first, then vertical edges
+static int edgeId(int i, int j, int edge) {
+    int res = Surface::resolution;
+    int horizontal = res * (res - 1);
+    switch (edge) {
+    case 0:  return j * (res - 1) + i;
+    case 2:  return (j + 1) * (res - 1) + i;
+    case 3:  return horizontal + j * res + i;
+    default: return horizontal + j * res + i + 1;
+    }
+}
+
+static glm::vec2 edgeVertex(int id) {
+    int res = Surface::resolution;
+    int horizontal = res * (res - 1);
+    int a, b;
+    if (id < horizontal) {
+        int j = id / (res - 1), i = id % (res - 1);
+        a = j * res + i;
+        b = a + 1;
+    }
+    else {
+        id -= horizontal;
+        a = id;
+        b = id + res;
+    }
+    float da = Surface::density[a];
+    float db = Surface::density[b];
+    float t = (db != da) ? (Surface::isoLevel - da) / (db - da) : 0.5f;
+    t = glm::clamp(t, 0.0f, 1.0f);
+    float h = nodeSpacing();
+    glm::vec2 pa(-1.0f + (a % res) * h, -1.0f + (a / res) * h);
+    glm::vec2 pb(-1.0f + (b % res) * h, -1.0f + (b / res) * h);
+    return pa + t * (pb - pa);
+}
+
+template <typename View>
+static void gather(const View& view) {
+    int res = Surface::resolution;
+    float h = nodeSpacing();
+
+    // each node only visits the particles of its 3x3 cell neighborhood
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < res; j++) {
+        for (int i = 0; i < res; i++) {
+            glm::vec3 node = glm::vec3(-1.0f + i * h, -1.0f + j * h, 0.0f);
+            int cellX = Particle::cells.cellOf(node.x);
+            int cellY = Particle::cells.cellOf(node.y);
+            float dens = 0.0f;
+            float weight = 0.0f;
+            glm::vec2 vel = glm::vec2(0.0f);
+            for (int x = cellX - 1; x <= cellX + 1; x++) {
+                for (int y = cellY - 1; y <= cellY + 1; y++) {
+                    const std::vector <int>& cell = Particle::cells.cell(x, y);
+                    for (int k = 0; k < cell.size(); k++) {
+                        float w = Particle::densityKernel(glm::length(view.pos(cell[k]) - node));
+                        dens += w;
+                        weight += w;
+                        vel += w * glm::vec2(view.velocity(cell[k]));
+                    }
+                }
+            }
+            Surface::density[j * res + i] = dens;
+            Surface::velocity[j * res + i] = weight > 0.0f ? vel / weight : glm::vec2(0.0f);
+        }
+    }
+}
+
+void Surface::resample() {
+    int res = resolution;
+    density.resize(res * res);
+    velocity.resize(res * res);
+
+    // the SPH solver's own state once it has loaded the particles, filed in the cells when first needed after a step
+    if (SphSolver<2, float>::loaded) {
+        SphSolver<2, float>::fileCells();
+        gather(SphSolver<2, float>::View());
+    }
+    else if (SphSolver<2, double>::loaded) {
+        SphSolver<2, double>::fileCells();
+        gather(SphSolver<2, double>::View());
+    }
+    else gather(ParticleView());
+}
+
+void Surface::extract() {
+    int res = resolution;
+    int numEdges = 2 * res * (res - 1);
+    rowSegments.resize(res - 1);
+
+    // classify cells row by row in parallel, each row owns its segment list
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < res - 1; j++) {
+        std::vector<int>& segs = rowSegments[j];
+        segs.clear();
+        for (int i = 0; i < res - 1; i++) {
+            float d0 = density[j * res + i];
+            float d1 = density[j * res + i + 1];
+            float d2 = density[(j + 1) * res + i + 1];
+            float d3 = density[(j + 1) * res + i];
+            int code = (d0 >= isoLevel ? 1 : 0) | (d1 >= isoLevel ? 2 : 0) | (d2 >= isoLevel ? 4 : 0) | (d3 >= isoLevel ? 8 : 0);
+            if (code == 0 || code == 15) continue;
+
+            const int* edges = caseEdges[code];
+            int saddle[4];
+            if (code == 5 || code == 10) {
+                bool center = 0.25f * (d0 + d1 + d2 + d3) >= isoLevel;
+                // connect the inside corners through the center or keep them apart
+                if ((code == 5) == center) { saddle[0] = 0; saddle[1] = 1; saddle[2] = 2; saddle[3] = 3; }
+                else                       { saddle[0] = 3; saddle[1] = 0; saddle[2] = 1; saddle[3] = 2; }
+                edges = saddle;
+            }
+            for (int k = 0; k < 4 && edges[k] >= 0; k += 2) {
+                segs.push_back(edgeId(i, j, edges[k]));
+                segs.push_back(edgeId(i, j, edges[k + 1]));
+            }
+        }
+    }
+
+    // gather segments and link them through their shared grid edges
+    segEdges.clear();
+    for (int j = 0; j < res - 1; j++) segEdges.insert(segEdges.end(), rowSegments[j].begin(), rowSegments[j].end());
+    int numSegs = (int)segEdges.size() / 2;
+
+    edgeSegs.assign(2 * numEdges, -1);
+    for (int s = 0; s < numSegs; s++) {
+        for (int k = 0; k < 2; k++) {
+            int e = segEdges[2 * s + k];
+            if (edgeSegs[2 * e] < 0) edgeSegs[2 * e] = s;
+            else edgeSegs[2 * e + 1] = s;
+        }
+    }
+    segVisited.assign(numSegs, 0);
+
+    vertices.clear();
+    polySpeeds.clear();
+    polyStarts.clear();
+    polyCounts.clear();
+
+    // walk open chains first (starting at an edge used once), then the closed loops
+    for (int pass = 0; pass < 2; pass++) {
+        for (int s = 0; s < numSegs; s++) {
+            if (segVisited[s]) continue;
+            int e = segEdges[2 * s];
+            if (pass == 0) {
+                if (edgeSegs[2 * e + 1] >= 0) {
+                    e = segEdges[2 * s + 1];
+                    if (edgeSegs[2 * e + 1] >= 0) continue;
+                }
+            }
+
+            int start = (int)vertices.size() / 2;
+            float speed = 0.0f;
+            int seg = s;
+            glm::vec2 v = edgeVertex(e);
+            vertices.push_back(v.x);
+            vertices.push_back(v.y);
+            while (seg >= 0 && !segVisited[seg]) {
+                segVisited[seg] = 1;
+                e = (segEdges[2 * seg] == e) ? segEdges[2 * seg + 1] : segEdges[2 * seg];
+                v = edgeVertex(e);
+                vertices.push_back(v.x);
+                vertices.push_back(v.y);
+
+                int node = (int)((v.y + 1.0f) / nodeSpacing() + 0.5f) * res + (int)((v.x + 1.0f) / nodeSpacing() + 0.5f);
+                speed += glm::length(velocity[node]);
+                seg = (edgeSegs[2 * e] == seg) ? edgeSegs[2 * e + 1] : edgeSegs[2 * e];
+            }
+            int count = (int)vertices.size() / 2 - start;
+            polyStarts.push_back(start);
+            polyCounts.push_back(count);
+            polySpeeds.push_back(speed / (float)(count - 1));
+        }
+    }
+}
+
+void Surface::drawElements(int object_Location, int color_Location) {
+    if (vertices.empty()) return;
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_DYNAMIC_DRAW);
+
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glVertexAttrib3f(1, 0.0f, 0.0f, 1.0f);
+    glVertexAttrib3f(2, 1.0f, 1.0f, 1.0f);
+
+    glUniform4f(object_Location, 0.0f, 0.0f, 0.0f, 0.0f);
+    for (int i = 0; i < polyStarts.size(); i++) {
+        // same palette as the particles
+        glm::vec3 color = speedToColor(polySpeeds[i]);
+        glUniform3f(color_Location, color.r, color.g, color.b);
+        glDrawArrays(GL_LINE_STRIP, polyStarts[i], polyCounts[i]);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+bool Surface::exportOBJ(const std::string& filePath) {
+    std::ofstream stream(filePath);
+    if (!stream) return false;
+
+    stream << "# Fluid surface: " << polyStarts.size() << " polylines, " << vertices.size() / 2 << " vertices\n";
+    for (int i = 0; i < vertices.size(); i += 2)
+        stream << "v " << vertices[i] << " " << vertices[i + 1] << " 0\n";
+    for (int i = 0; i < polyStarts.size(); i++) {
+        stream << "l";
+        for (int k = 0; k < polyCounts[i]; k++) stream << " " << polyStarts[i] + k + 1;
+        stream << "\n";
+    }
+    return true;
+}
+
+size_t Surface::footprint() {
+    return vertices.size() * sizeof(float) + polyStarts.size() * 2 * sizeof(int);
+}
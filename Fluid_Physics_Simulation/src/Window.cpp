@@ -4,9 +4,18 @@
 unsigned int Window::vao = 0;
 unsigned int Window::vbo = 0;
 
-Window :: Window(int w, int h, bool waitVSync) {
+Window :: Window(int w, int h, bool waitVSync, int glMajor, int glMinor, bool visible) {
     glfwInit();
 
+    // a specific version (e.g. 4.3 for compute shaders) is requested as a core profile
+    if (glMajor > 0) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, glMajor);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, glMinor);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    }
+    // the check modes only need the context, so that they can run unattended
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
+
     GLFWwindow* window;
     width = w;
     height = h;
@@ -28,6 +37,7 @@ Window :: Window(int w, int h, bool waitVSync) {
     else
         glfwSwapInterval(0);
 
+    glewExperimental = GL_TRUE;
 #if USE_CPP_IOSTREAM
     if (glewInit() != GLEW_OK) std::cout << "Error!" << std::endl;
 #else
@@ -38,15 +48,20 @@ Window :: Window(int w, int h, bool waitVSync) {
 void Window::drawBoundary(int object_Location, int color_Location) {
     glBindVertexArray(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, 8 * sizeof(float), recData.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, recData.size() * sizeof(float), recData.data(), GL_STATIC_DRAW);
 
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
+    // not instanced: unit scale, white
+    glVertexAttrib3f(1, 0.0f, 0.0f, 1.0f);
+    glVertexAttrib3f(2, 1.0f, 1.0f, 1.0f);
+
     glUniform4f(object_Location, 0.0f, 0.0f, 0.0f, 0.0f);
     glUniform3f(color_Location, 1.0f, 1.0f, 1.0f);
 
-    glDrawArrays(GL_LINE_LOOP, 0, 4);
+    for (int i = 0; i + 1 < recLoops.size(); i += 2)
+        glDrawArrays(GL_LINE_LOOP, recLoops[i], recLoops[i + 1]);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 }
\ No newline at end of file